@@ -6,7 +6,3 @@
 Color Air::getColor(Vector point) {
    return Color(0.0, 0.0, 0.0);
 }
-
-double Air::getRefractiveIndex() {
-   return AIR_REFRACTIVE_INDEX;
-}
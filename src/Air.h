@@ -5,10 +5,11 @@
 
 class Air : public Material {
 public:
-   Air() {}
+   Air() : Material(MATERIAL_AIR) {
+      refractiveIndex = AIR_REFRACTIVE_INDEX;
+   }
 
    virtual Color getColor(Vector);
-   virtual double getRefractiveIndex();
 };
 
 #endif
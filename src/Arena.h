@@ -0,0 +1,61 @@
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include <stdlib.h>
+#include <new>
+#include <vector>
+
+// Objects per slab. Big enough that a 100k-triangle model touches a few
+// dozen allocations instead of 100k, small enough not to waste much on
+// tiny scenes.
+#define ARENA_SLAB_SIZE 4096
+
+/**
+ * Typed arena that owns primitives in contiguous slabs. allocate() hands
+ * back raw storage for one T (construct into it with placement new) and
+ * the destructor tears everything down en masse, so per-primitive news
+ * and deletes disappear and primitives of a type sit sequentially in
+ * memory.
+ */
+template <class T>
+class Arena {
+public:
+   Arena() : used(ARENA_SLAB_SIZE) {}
+
+   ~Arena() {
+      for (size_t i = 0; i < slabs.size(); i++) {
+         size_t count = i + 1 == slabs.size() ? used : ARENA_SLAB_SIZE;
+
+         for (size_t j = 0; j < count; j++) {
+            slabs[i][j].~T();
+         }
+
+         free(slabs[i]);
+      }
+   }
+
+   // Resident bytes, slab-granular: the tail slab counts in full since
+   // its storage is committed either way.
+   size_t bytes() const {
+      return slabs.size() * sizeof(T) * ARENA_SLAB_SIZE;
+   }
+
+   T* allocate() {
+      if (used == ARENA_SLAB_SIZE) {
+         slabs.push_back((T*)malloc(sizeof(T) * ARENA_SLAB_SIZE));
+         used = 0;
+      }
+
+      return &slabs.back()[used++];
+   }
+
+private:
+   std::vector<T*> slabs;
+   size_t used;
+
+   // Slabs own live objects - copying would double-destroy them.
+   Arena(const Arena&);
+   Arena& operator=(const Arena&);
+};
+
+#endif
@@ -1,14 +1,104 @@
 #include "BSP.h"
+#include <algorithm>
 #include <limits>
+#include <map>
+#include <utility>
 #include "Object.h"
 #include "Intersection.h"
+#include "RenderStats.h"
 
 using namespace std;
 
-void BSP::build() {
-   // Make sure all objects are properly wrapped
-   for (vector<Object*>::iterator itr = objects.begin(); itr < objects.end(); itr++) {
-     Boundaries curr = (*itr)->getBounds();
+/**
+ * Small value type sorted by centroid during the SAH sweep. Carrying the
+ * bounds along keeps the sweep loops free of virtual getBounds calls.
+ */
+class SortedObject {
+public:
+   double centroid;
+   Object* object;
+   Boundaries bounds;
+
+   bool operator < (const SortedObject& other) const {
+      return centroid < other.centroid;
+   }
+};
+
+BSP::BSP(const vector<Object*>& objects_) : objects(objects_),
+ medianSplits(0) {
+   int count = (int)objects.size();
+
+   // Every object's bounds get cached up front as a parallel pass - the
+   // build reads them over and over in the sweep loops.
+   buildBounds.resize(count);
+
+   #pragma omp parallel for
+   for (int i = 0; i < count; i++) {
+      buildBounds[i] = objects[i]->getBounds();
+   }
+
+   // Large subtrees fork into OpenMP tasks that build private node arenas,
+   // spliced back into the parent arena once both children finish.
+   #pragma omp parallel
+   #pragma omp single
+   build(0, count, 0, nodes);
+
+   buildBounds.clear();
+   summarizeLeaves();
+}
+
+// Leaf-occupancy summary for the build report. Walked after the build
+// instead of tallied inside it so the task-parallel path stays free of
+// shared counters on the hot loops.
+void BSP::summarizeLeaves() {
+   int leaves = 0;
+   int maxLeaf = 0;
+   int oversized = 0;
+
+   for (vector<Node>::const_iterator itr = nodes.begin(); itr < nodes.end();
+        itr++) {
+      if (itr->left < 0) {
+         leaves++;
+         maxLeaf = max(maxLeaf, itr->objectCount);
+
+         if (itr->objectCount > MIN_OBJECT_COUNT) {
+            oversized++;
+         }
+      }
+   }
+
+   renderStats.bspLeaves = leaves;
+   renderStats.bspMaxLeafSize = maxLeaf;
+   renderStats.bspOversizedLeaves = oversized;
+   renderStats.bspMedianSplits = medianSplits;
+}
+
+/**
+ * Builds the node for objects [begin, end) into the arena and returns its
+ * index. Children are built recursively; interior nodes never hold objects,
+ * they just reorder the [begin, end) range so each leaf owns a contiguous
+ * chunk of it. Subtrees above MIN_PARALLEL_COUNT objects build their left
+ * child in a separate OpenMP task; tasks touch disjoint object ranges and
+ * write into private arenas, so they never contend.
+ *
+ * Partitioning by centroid means every object lands in exactly one leaf
+ * (a straddling object just fattens its side's bounds), so a ray never
+ * tests the same primitive in two leaves and no per-ray mailboxing is
+ * needed in traversal.
+ */
+int BSP::build(int begin, int end, int depth, vector<Node>& arena) {
+   int nodeIndex = (int)arena.size();
+   arena.push_back(Node());
+
+   int count = end - begin;
+   Boundaries bounds;
+
+   if (count > 0) {
+      bounds = buildBounds[begin];
+   }
+
+   for (int i = begin + 1; i < end; i++) {
+     const Boundaries& curr = buildBounds[i];
      bounds.min = Vector(min(bounds.min.x, curr.min.x),
                          min(bounds.min.y, curr.min.y),
                          min(bounds.min.z, curr.min.z));
@@ -17,107 +107,600 @@ void BSP::build() {
                          max(bounds.max.z, curr.max.z));
    }
 
-   // For debugging.
-   if (true) {
+   arena[nodeIndex].bounds = bounds;
+
+   // Per-node build dump, compiled out by default: it prints one line per
+   // tree node, which for a large model is thousands of lines of console
+   // I/O before the render starts. Build with BSPDUMP=-DRT_BSP_DUMP to get
+   // it back. Tasks print concurrently, so lines from different subtrees
+   // interleave but never tear.
+#ifdef RT_BSP_DUMP
+   #pragma omp critical(bspBuildDump)
+   {
       for (int i = 0; i < depth; i++) {
         cout << "\t";
       }
-      cout << objects.size() << " | " <<
+      cout << count << " | " <<
          bounds.min.x << ", " << bounds.min.y << ", " << bounds.min.z << " || " <<
-         bounds.max.x << ", " << bounds.max.y << ", " << bounds.max.z <<
-         " % " << axis << " X " << axisRetries << endl;
+         bounds.max.x << ", " << bounds.max.y << ", " << bounds.max.z << endl;
    }
+#endif
 
    // We've hit our limit so this is a leaf node. No need to split again.
-   if (objects.size() <= MIN_OBJECT_COUNT) {
-      return;
+   if (count <= MIN_OBJECT_COUNT) {
+      arena[nodeIndex].firstObject = begin;
+      arena[nodeIndex].objectCount = count;
+      return nodeIndex;
+   }
+
+   // Split along the axis where the object centroids are spread the widest.
+   Boundaries centroidBounds;
+   centroidBounds.min = Vector(numeric_limits<double>::max());
+   centroidBounds.max = Vector(-numeric_limits<double>::max());
+
+   for (int i = begin; i < end; i++) {
+      const Boundaries& curr = buildBounds[i];
+      Vector centroid = (curr.min + curr.max) * 0.5;
+
+      centroidBounds.min = Vector(min(centroidBounds.min.x, centroid.x),
+                                  min(centroidBounds.min.y, centroid.y),
+                                  min(centroidBounds.min.z, centroid.z));
+      centroidBounds.max = Vector(max(centroidBounds.max.x, centroid.x),
+                                  max(centroidBounds.max.y, centroid.y),
+                                  max(centroidBounds.max.z, centroid.z));
    }
 
-   // Where to split the bounds
-   double splitValue = bounds.splitValue(axis);
+   Vector centroidExtent = centroidBounds.max - centroidBounds.min;
+   char axis = 'x';
+   double axisExtent = centroidExtent.x;
 
-   vector<Object*> leftObjects;
-   vector<Object*> rightObjects;
+   if (centroidExtent.y > centroidExtent.x && centroidExtent.y >= centroidExtent.z) {
+      axis = 'y';
+      axisExtent = centroidExtent.y;
+   } else if (centroidExtent.z > centroidExtent.x && centroidExtent.z > centroidExtent.y) {
+      axis = 'z';
+      axisExtent = centroidExtent.z;
+   }
+
+   // Sort the range by centroid along the chosen axis so a single sweep can
+   // evaluate every possible partition with the surface area heuristic.
+   vector<SortedObject> sorted;
+   sorted.resize(count);
 
-   for (vector<Object*>::iterator itr = objects.begin(); itr < objects.end(); itr++) {
-      Object* obj = *itr;
-      Boundaries curr = obj->getBounds();
-      double min, max;
+   for (int i = begin; i < end; i++) {
+      SortedObject& entry = sorted[i - begin];
+      entry.object = objects[i];
+      entry.bounds = buildBounds[i];
 
       switch(axis) {
-         case 'x':
-            min = curr.min.x;
-            max = curr.max.x;
-            break;
          case 'y':
-            min = curr.min.y;
-            max = curr.max.y;
+            entry.centroid = (entry.bounds.min.y + entry.bounds.max.y) / 2;
             break;
          case 'z':
-            min = curr.min.z;
-            max = curr.max.z;
+            entry.centroid = (entry.bounds.min.z + entry.bounds.max.z) / 2;
+            break;
+         default:
+            entry.centroid = (entry.bounds.min.x + entry.bounds.max.x) / 2;
             break;
       }
+   }
+
+   sort(sorted.begin(), sorted.end());
+
+   // Suffix pass: surface area of the bounds of objects [i, count).
+   vector<double> rightArea(count + 1);
+   Boundaries rightBounds;
+   rightBounds.min = Vector(numeric_limits<double>::max());
+   rightBounds.max = Vector(-numeric_limits<double>::max());
+   rightArea[count] = 0.0;
+
+   for (int i = count - 1; i >= 0; i--) {
+      const Boundaries& curr = sorted[i].bounds;
+      rightBounds.min = Vector(min(rightBounds.min.x, curr.min.x),
+                               min(rightBounds.min.y, curr.min.y),
+                               min(rightBounds.min.z, curr.min.z));
+      rightBounds.max = Vector(max(rightBounds.max.x, curr.max.x),
+                               max(rightBounds.max.y, curr.max.y),
+                               max(rightBounds.max.z, curr.max.z));
+      rightArea[i] = rightBounds.surfaceArea();
+   }
 
-      if (min < splitValue) {
-         leftObjects.push_back(obj);
+   // Prefix sweep: pick the partition that minimizes the SAH cost
+   // leftCount * leftArea + rightCount * rightArea.
+   Boundaries leftBounds;
+   leftBounds.min = Vector(numeric_limits<double>::max());
+   leftBounds.max = Vector(-numeric_limits<double>::max());
+   double bestCost = numeric_limits<double>::max();
+   int bestSplit = count / 2;
+
+   for (int i = 1; i < count; i++) {
+      const Boundaries& curr = sorted[i - 1].bounds;
+      leftBounds.min = Vector(min(leftBounds.min.x, curr.min.x),
+                              min(leftBounds.min.y, curr.min.y),
+                              min(leftBounds.min.z, curr.min.z));
+      leftBounds.max = Vector(max(leftBounds.max.x, curr.max.x),
+                              max(leftBounds.max.y, curr.max.y),
+                              max(leftBounds.max.z, curr.max.z));
+
+      double cost = i * leftBounds.surfaceArea() + (count - i) * rightArea[i];
+
+      if (cost < bestCost) {
+         bestCost = cost;
+         bestSplit = i;
       }
+   }
 
-      if (max > splitValue) {
-         rightObjects.push_back(obj);
+   // Splitting has to beat testing every object right here. A small range
+   // failing that test is the heuristic working as intended, but a large
+   // one means the sweep degenerated (heavily overlapping bounds, say) and
+   // the resulting leaf would punish every passing ray with a linear scan.
+   // Those get re-split at the object median instead - as long as the
+   // centroids actually spread, since coincident objects can't be separated.
+   if (bestCost >= count * bounds.surfaceArea()) {
+      if (count <= 4 * MIN_OBJECT_COUNT || axisExtent <= 0.0) {
+         arena[nodeIndex].firstObject = begin;
+         arena[nodeIndex].objectCount = count;
+         return nodeIndex;
       }
+
+      bestSplit = count / 2;
+
+      #pragma omp atomic
+      medianSplits++;
    }
 
-   int newAxis = toggleAxis();
+   // Write the sorted order back into the shared arrays - no per-node copies.
+   for (int i = 0; i < count; i++) {
+      objects[begin + i] = sorted[i].object;
+      buildBounds[begin + i] = sorted[i].bounds;
+   }
+
+   if (count >= MIN_PARALLEL_COUNT) {
+      // Build the left child in its own task and private arena while this
+      // thread takes the right child, then splice the left arena in with
+      // its indices rebased.
+      vector<Node> leftArena;
+
+      #pragma omp task shared(leftArena)
+      build(begin, begin + bestSplit, depth + 1, leftArena);
+
+      int rightIndex = build(begin + bestSplit, end, depth + 1, arena);
+
+      #pragma omp taskwait
+
+      int offset = (int)arena.size();
 
-   if (leftObjects.size() != objects.size() &&
-       rightObjects.size() != objects.size()) {
-      // Since this split separated geometry a little bit, make children to
-      // split up geometry further.
-      left = new BSP(depth + 1, newAxis, leftObjects);
-      right = new BSP(depth + 1, newAxis, rightObjects);
-   } else if (axisRetries < 2) {
-      axis = toggleAxis();
-      axisRetries++;
-      build();
-   } else {
-      // Do nothing since we're out of axis retries.
+      for (vector<Node>::iterator itr = leftArena.begin();
+           itr < leftArena.end(); itr++) {
+         if (itr->left >= 0) {
+            itr->left += offset;
+            itr->right += offset;
+         }
+
+         arena.push_back(*itr);
+      }
+
+      arena[nodeIndex].left = offset;
+      arena[nodeIndex].right = rightIndex;
+
+      return nodeIndex;
    }
+
+   // Can't hold a Node reference across these calls since the arena grows.
+   int leftIndex = build(begin, begin + bestSplit, depth + 1, arena);
+   int rightIndex = build(begin + bestSplit, end, depth + 1, arena);
+
+   arena[nodeIndex].left = leftIndex;
+   arena[nodeIndex].right = rightIndex;
+
+   return nodeIndex;
 }
 
-char BSP::toggleAxis() {
-   return axis == 'x' ? 'y' : (axis == 'y' ? 'z' : 'x');
+void BSP::getClosestHit(const Ray& ray, Hit& hit) {
+   double entry;
+
+   if (!nodes.empty() && nodes[0].bounds.intersect(ray, &entry)) {
+      getClosestHit(0, ray, hit);
+   }
 }
 
 Intersection BSP::getClosestIntersection(const Ray& ray) {
-   double distance;
-   if (!bounds.intersect(ray, &distance)) {
+   Hit hit;
+   double entry;
+
+   if (!nodes.empty() && nodes[0].bounds.intersect(ray, &entry)) {
+      getClosestHit(0, ray, hit);
+   }
+
+   if (hit.object == NULL) {
       return Intersection();
    }
 
-   if (left != NULL && right != NULL) {
-      Intersection leftIntersection = left->getClosestIntersection(ray);
-      Intersection rightIntersection = right->getClosestIntersection(ray);
+   // Only the winning hit pays for the full shading record.
+   return hit.object->getIntersection(ray, hit);
+}
+
+/**
+ * Visits the nearer child first and prunes the farther child whenever the
+ * best hit so far is closer than the farther child's entry distance.
+ */
+void BSP::getClosestHit(int nodeIndex, const Ray& ray, Hit& hit) {
+   const Node& node = nodes[nodeIndex];
+
+   renderStats.local().nodesVisited++;
+
+   if (node.left < 0) {
+      // No children so just go through current objects like normal. The
+      // running closest distance lets primitives early-out.
+      renderStats.local().objectTests += node.objectCount;
+
+      for (int i = node.firstObject; i < node.firstObject + node.objectCount; i++) {
+         objects[i]->intersect(ray, hit.distance, hit);
+      }
 
-      return leftIntersection.distance < rightIntersection.distance ?
-       leftIntersection : rightIntersection;
-   } else {
-      return getClosestObjectIntersection(ray);
+      return;
+   }
+
+   double leftEntry, rightEntry;
+   bool hitLeft = nodes[node.left].bounds.intersect(ray, &leftEntry);
+   bool hitRight = nodes[node.right].bounds.intersect(ray, &rightEntry);
+
+   int nearChild = node.left;
+   int farChild = node.right;
+   double farEntry = rightEntry;
+
+   if (!hitLeft || (hitRight && rightEntry < leftEntry)) {
+      nearChild = node.right;
+      farChild = node.left;
+      farEntry = leftEntry;
+   }
+
+   if (hitLeft || hitRight) {
+      getClosestHit(nearChild, ray, hit);
+   }
+
+   if (hitLeft && hitRight && farEntry < hit.distance) {
+      getClosestHit(farChild, ray, hit);
    }
 }
 
-Intersection BSP::getClosestObjectIntersection(const Ray& ray) {
-   // No children so just go through current objects like normal.
-   Intersection closestIntersection;
+/**
+ * Traces a packet of up to PACKET_SIZE coherent rays together. The packet
+ * shares one traversal: a node is visited if any ray in the packet can
+ * still find a closer hit inside it, and leaves run every primitive
+ * against the whole packet so the AABB and primitive math batch up.
+ */
+void BSP::getClosestIntersections(const Ray rays[], int count,
+ Intersection intersections[]) {
+   Hit hits[PACKET_SIZE];
+   bool entered[PACKET_SIZE];
+   double entries[PACKET_SIZE];
 
-   for (vector<Object*>::iterator itr = objects.begin(); itr < objects.end(); itr++) {
-      Intersection intersection = (*itr)->intersect(ray);
+   if (!nodes.empty()) {
+      nodes[0].bounds.intersectPacket(rays, count, entered, entries);
+
+      for (int i = 0; i < count; i++) {
+         if (entered[i]) {
+            getClosestHits(0, rays, count, hits);
+            break;
+         }
+      }
+   }
 
-      if (intersection.didIntersect && intersection.distance <
-       closestIntersection.distance) {
-         closestIntersection = intersection;
+   for (int i = 0; i < count; i++) {
+      if (hits[i].object == NULL) {
+         intersections[i] = Intersection();
+      } else {
+         intersections[i] = hits[i].object->getIntersection(rays[i], hits[i]);
       }
    }
+}
+
+void BSP::getClosestHits(int nodeIndex, const Ray rays[], int count,
+ Hit hits[]) {
+   const Node& node = nodes[nodeIndex];
+
+   renderStats.local().nodesVisited++;
+
+   if (node.left < 0) {
+      renderStats.local().objectTests += node.objectCount * count;
+
+      for (int i = node.firstObject; i < node.firstObject + node.objectCount; i++) {
+         for (int r = 0; r < count; r++) {
+            objects[i]->intersect(rays[r], hits[r].distance, hits[r]);
+         }
+      }
+
+      return;
+   }
+
+   bool leftHits[PACKET_SIZE], rightHits[PACKET_SIZE];
+   double leftEntries[PACKET_SIZE], rightEntries[PACKET_SIZE];
+
+   nodes[node.left].bounds.intersectPacket(rays, count, leftHits, leftEntries);
+   nodes[node.right].bounds.intersectPacket(rays, count, rightHits, rightEntries);
+
+   // A child is live while any ray in the packet can still improve inside it.
+   bool leftLive = false, rightLive = false;
+   double leftNearest = numeric_limits<double>::max();
+   double rightNearest = numeric_limits<double>::max();
+
+   for (int r = 0; r < count; r++) {
+      leftLive |= leftHits[r] && leftEntries[r] < hits[r].distance;
+      rightLive |= rightHits[r] && rightEntries[r] < hits[r].distance;
+      leftNearest = leftHits[r] ? min(leftNearest, leftEntries[r]) : leftNearest;
+      rightNearest = rightHits[r] ? min(rightNearest, rightEntries[r]) : rightNearest;
+   }
+
+   int nearChild = node.left;
+   int farChild = node.right;
+   bool nearLive = leftLive;
+   bool* farHits = rightHits;
+   double* farEntries = rightEntries;
+
+   if (rightNearest < leftNearest) {
+      nearChild = node.right;
+      farChild = node.left;
+      nearLive = rightLive;
+      farHits = leftHits;
+      farEntries = leftEntries;
+   }
+
+   if (nearLive) {
+      getClosestHits(nearChild, rays, count, hits);
+   }
+
+   // Recheck the far child against distances tightened by the near child.
+   for (int r = 0; r < count; r++) {
+      if (farHits[r] && farEntries[r] < hits[r].distance) {
+         getClosestHits(farChild, rays, count, hits);
+         break;
+      }
+   }
+}
+
+/**
+ * Occlusion-only query for shadow rays. Stops on the first hit within
+ * maxDistance rather than searching for the nearest one, and returns the
+ * occluding object (or NULL) so callers can cache it.
+ */
+Object* BSP::anyIntersection(const Ray& ray, double maxDistance) {
+   double entry;
+
+   if (nodes.empty() || !nodes[0].bounds.intersect(ray, &entry) ||
+    entry > maxDistance) {
+      return NULL;
+   }
+
+   return anyIntersection(0, ray, maxDistance);
+}
+
+Object* BSP::anyIntersection(int nodeIndex, const Ray& ray, double maxDistance) {
+   const Node& node = nodes[nodeIndex];
+
+   renderStats.local().nodesVisited++;
+
+   if (node.left >= 0) {
+      double entry;
+
+      if (nodes[node.left].bounds.intersect(ray, &entry) &&
+       entry <= maxDistance) {
+         Object* occluder = anyIntersection(node.left, ray, maxDistance);
+
+         if (occluder != NULL) {
+            return occluder;
+         }
+      }
+
+      if (nodes[node.right].bounds.intersect(ray, &entry) &&
+       entry <= maxDistance) {
+         return anyIntersection(node.right, ray, maxDistance);
+      }
+
+      return NULL;
+   }
+
+   for (int i = node.firstObject; i < node.firstObject + node.objectCount; i++) {
+      renderStats.local().objectTests++;
+
+      if (objects[i]->anyIntersection(ray, maxDistance)) {
+         return objects[i];
+      }
+   }
+
+   return NULL;
+}
+
+/**
+ * Occlusion query for a packet of up to PACKET_SIZE shadow rays sharing
+ * one traversal, the any-hit counterpart of getClosestIntersections.
+ * Rays from one shading point toward different lights are coherent
+ * enough to batch the AABB tests; each ray drops out of the walk as soon
+ * as any occluder turns up, and the whole walk ends once every ray has
+ * one. Which occluder a blocked ray reports depends on visit order, but
+ * whether it is blocked does not.
+ */
+void BSP::anyIntersections(const Ray rays[], int count,
+ const double maxDistances[], Object* occluders[]) {
+   for (int i = 0; i < count; i++) {
+      occluders[i] = NULL;
+   }
+
+   if (nodes.empty()) {
+      return;
+   }
+
+   bool entered[PACKET_SIZE];
+   double entries[PACKET_SIZE];
+
+   nodes[0].bounds.intersectPacket(rays, count, entered, entries);
+
+   for (int i = 0; i < count; i++) {
+      if (entered[i] && entries[i] <= maxDistances[i]) {
+         int remaining = count;
+
+         anyIntersections(0, rays, count, maxDistances, occluders, remaining);
+         break;
+      }
+   }
+}
+
+void BSP::anyIntersections(int nodeIndex, const Ray rays[], int count,
+ const double maxDistances[], Object* occluders[], int& remaining) {
+   const Node& node = nodes[nodeIndex];
+
+   renderStats.local().nodesVisited++;
+
+   if (node.left < 0) {
+      for (int i = node.firstObject; i < node.firstObject + node.objectCount; i++) {
+         for (int r = 0; r < count; r++) {
+            if (occluders[r] != NULL) {
+               continue;
+            }
+
+            renderStats.local().objectTests++;
+
+            if (objects[i]->anyIntersection(rays[r], maxDistances[r])) {
+               occluders[r] = objects[i];
+
+               if (--remaining == 0) {
+                  return;
+               }
+            }
+         }
+      }
+
+      return;
+   }
+
+   bool childHits[PACKET_SIZE];
+   double childEntries[PACKET_SIZE];
+   int children[2] = { node.left, node.right };
+
+   // No near/far ordering here - any hit ends a ray, so there's nothing
+   // to tighten by visiting the closer child first.
+   for (int c = 0; c < 2; c++) {
+      nodes[children[c]].bounds.intersectPacket(rays, count, childHits,
+       childEntries);
+
+      for (int r = 0; r < count; r++) {
+         if (occluders[r] == NULL && childHits[r] &&
+          childEntries[r] <= maxDistances[r]) {
+            anyIntersections(children[c], rays, count, maxDistances,
+             occluders, remaining);
+            break;
+         }
+      }
+
+      if (remaining == 0) {
+         return;
+      }
+   }
+}
+
+// Warm-start sidecar format. The magic bakes in the node size so caches
+// from other precisions or node layouts are rejected; bump the version
+// when the build algorithm changes, since a cache built by an old
+// heuristic would silently keep its shape.
+#define BVH_CACHE_VERSION 1
+#define BVH_CACHE_MAGIC (0x42535452 + (BVH_CACHE_VERSION << 8) + \
+ (unsigned int)sizeof(BSP::Node))
+
+/**
+ * FNV-1a over the raw bounds scalars of every object, in order. The tree
+ * depends on nothing but this geometry, so matching hashes mean a stored
+ * tree is valid no matter which file it originally came from.
+ */
+static unsigned long long hashObjectBounds(const vector<Object*>& objects) {
+   unsigned long long hash = 14695981039346656037ULL;
+
+   for (vector<Object*>::const_iterator itr = objects.begin();
+        itr < objects.end(); itr++) {
+      Boundaries bounds = (*itr)->getBounds();
+      Scalar scalars[6] = { bounds.min.x, bounds.min.y, bounds.min.z,
+       bounds.max.x, bounds.max.y, bounds.max.z };
+      const unsigned char* bytes = (const unsigned char*)scalars;
+
+      for (unsigned int i = 0; i < sizeof(scalars); i++) {
+         hash = (hash ^ bytes[i]) * 1099511628211ULL;
+      }
+   }
+
+   return hash;
+}
+
+void BSP::store(FILE* out, const vector<Object*>& original) const {
+   unsigned int header[3] = { BVH_CACHE_MAGIC, (unsigned int)nodes.size(),
+    (unsigned int)objects.size() };
+   unsigned long long hash = hashObjectBounds(original);
+
+   // The stored object order is a permutation of the caller's array, so
+   // the cache holds indices into it rather than anything pointer-shaped.
+   map<Object*, int> position;
+
+   for (int i = 0; i < (int)original.size(); i++) {
+      position[original[i]] = i;
+   }
+
+   vector<int> permutation(objects.size());
+
+   for (int i = 0; i < (int)objects.size(); i++) {
+      permutation[i] = position[objects[i]];
+   }
+
+   fwrite(header, sizeof(header), 1, out);
+   fwrite(&hash, sizeof(hash), 1, out);
+
+   if (!permutation.empty()) {
+      fwrite(&permutation[0], sizeof(int), permutation.size(), out);
+   }
+
+   if (!nodes.empty()) {
+      fwrite(&nodes[0], sizeof(Node), nodes.size(), out);
+   }
+}
+
+BSP* BSP::load(FILE* in, const vector<Object*>& original) {
+   unsigned int header[3];
+   unsigned long long hash;
+
+   if (fread(header, sizeof(unsigned int), 3, in) != 3 ||
+       header[0] != BVH_CACHE_MAGIC ||
+       header[2] != original.size() ||
+       fread(&hash, sizeof(hash), 1, in) != 1 ||
+       hash != hashObjectBounds(original)) {
+      return NULL;
+   }
+
+   vector<int> permutation(header[2]);
+   BSP* bsp = new BSP();
+
+   bsp->nodes.resize(header[1]);
+
+   bool ok =
+    (permutation.empty() ||
+     fread(&permutation[0], sizeof(int), permutation.size(), in) ==
+      permutation.size()) &&
+    (bsp->nodes.empty() ||
+     fread(&bsp->nodes[0], sizeof(Node), bsp->nodes.size(), in) ==
+      bsp->nodes.size());
+
+   for (int i = 0; ok && i < (int)permutation.size(); i++) {
+      ok = permutation[i] >= 0 && permutation[i] < (int)original.size();
+   }
+
+   if (!ok) {
+      delete bsp;
+      return NULL;
+   }
+
+   bsp->objects.resize(original.size());
+
+   for (int i = 0; i < (int)permutation.size(); i++) {
+      bsp->objects[i] = original[permutation[i]];
+   }
+
+   bsp->summarizeLeaves();
 
-   return closestIntersection;
+   return bsp;
 }
@@ -2,39 +2,86 @@
 #define __BSP_H__
 
 #include <math.h>
+#include <stdio.h>
 #include <vector>
 #include "Boundaries.h"
 #include "Ray.h"
 
 class Object;
+class Hit;
 class Intersection;
 
 #define MIN_OBJECT_COUNT 20
+#define MIN_PARALLEL_COUNT 4096
+#define PACKET_SIZE 4
 
+/**
+ * Bounding volume hierarchy over the scene objects. Each object lands in
+ * exactly one leaf and splits are chosen with the surface area heuristic.
+ * The name is historical - this started out as a midpoint BSP.
+ *
+ * All nodes live in one contiguous arena and refer to their children by
+ * index, and each leaf owns a contiguous range of the shared object array,
+ * so traversal walks packed memory instead of chasing heap pointers.
+ */
 class BSP {
 private:
-   int depth;
-   int axisRetries;
-   char axis;
-   Boundaries bounds;
+   class Node {
+   public:
+      Boundaries bounds;
+      int left; // Indices into the node arena, or -1 for leaves.
+      int right;
+      int firstObject; // Range into the object array. Only set for leaves.
+      int objectCount;
+
+      Node() : left(-1), right(-1), firstObject(0), objectCount(0) {}
+   };
+
+   std::vector<Node> nodes;
    std::vector<Object*> objects;
-   BSP* left;
-   BSP* right;
+   std::vector<Boundaries> buildBounds; // Cached object bounds, build only.
+   int medianSplits; // Oversized SAH-refused ranges re-split at the median.
 
-   void build();
-   char toggleAxis();
+   BSP() : medianSplits(0) {} // Shell for load() to fill in.
+
+   int build(int begin, int end, int depth, std::vector<Node>& arena);
+   void summarizeLeaves();
+   void getClosestHit(int nodeIndex, const Ray&, Hit&);
+   void getClosestHits(int nodeIndex, const Ray rays[], int count, Hit hits[]);
+   Object* anyIntersection(int nodeIndex, const Ray&, double maxDistance);
+   void anyIntersections(int nodeIndex, const Ray rays[], int count,
+    const double maxDistances[], Object* occluders[], int& remaining);
 
 public:
 
-   BSP(int depth_, char axis_, std::vector<Object*> objects_) :
-    depth(depth_), axis(axis_), objects(objects_) {
-      axisRetries = 0;
-      left = right = NULL;
-      build();
-   }
+   BSP(const std::vector<Object*>& objects_);
+
+   // Warm-start cache: store() persists the flattened node arena plus the
+   // object permutation the build produced, keyed by a hash of the object
+   // bounds; load() rebuilds a tree from that against the same geometry
+   // and returns NULL on any mismatch, in which case the caller builds
+   // normally.
+   static BSP* load(FILE* in, const std::vector<Object*>& original);
+   void store(FILE* out, const std::vector<Object*>& original) const;
 
    Intersection getClosestIntersection(const Ray&);
-   Intersection getClosestObjectIntersection(const Ray&);
+
+   // Hit-level entry point for nested trees (instances): the same
+   // traversal as getClosestIntersection without materializing the
+   // shading record, and it respects a pre-seeded hit distance.
+   void getClosestHit(const Ray&, Hit&);
+   void getClosestIntersections(const Ray rays[], int count,
+    Intersection intersections[]);
+   Object* anyIntersection(const Ray&, double maxDistance);
+   void anyIntersections(const Ray rays[], int count,
+    const double maxDistances[], Object* occluders[]);
+
+   // Resident bytes: the node arena plus this tree's copy of the object
+   // list.
+   size_t memoryBytes() const {
+      return nodes.capacity() * sizeof(Node) +
+       objects.capacity() * sizeof(Object*);
+   }
 };
 
 #endif
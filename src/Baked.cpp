@@ -0,0 +1,78 @@
+#include "Baked.h"
+
+/**
+ * Samples the source material at every grid corner. Corners span the
+ * bounds inclusively, so lookups inside them always interpolate between
+ * real samples instead of extrapolating. The bake parallelizes over
+ * slices - it's load-time work, but a fine grid over an expensive
+ * material is still millions of noise evaluations.
+ */
+Baked::Baked(Material* source_, int resolution_, const Vector& minBound_,
+ const Vector& maxBound_) : Material(MATERIAL_BAKED), source(source_),
+ minBound(minBound_), resolution(resolution_) {
+   shininess = source->getShininess();
+   reflectivity = source->getReflectivity();
+   refractiveIndex = source->getRefractiveIndex();
+
+   Vector extent = maxBound_ - minBound_;
+   int corners = resolution + 1;
+
+   // A degenerate axis collapses every lookup onto its low face.
+   cellScale = Vector(extent.x > 0.0 ? resolution / extent.x : 0.0,
+    extent.y > 0.0 ? resolution / extent.y : 0.0,
+    extent.z > 0.0 ? resolution / extent.z : 0.0);
+
+   grid.resize((size_t)corners * corners * corners);
+
+   #pragma omp parallel for schedule(dynamic)
+   for (int z = 0; z < corners; z++) {
+      for (int y = 0; y < corners; y++) {
+         for (int x = 0; x < corners; x++) {
+            Vector point(minBound.x + (extent.x * x) / resolution,
+             minBound.y + (extent.y * y) / resolution,
+             minBound.z + (extent.z * z) / resolution);
+
+            grid[((size_t)z * corners + y) * corners + x] =
+             source->getColor(point);
+         }
+      }
+   }
+}
+
+Color Baked::getColor(Vector point) {
+   double gx = (point.x - minBound.x) * cellScale.x;
+   double gy = (point.y - minBound.y) * cellScale.y;
+   double gz = (point.z - minBound.z) * cellScale.z;
+
+   // Points outside the baked bounds clamp to the boundary cells.
+   gx = gx < 0.0 ? 0.0 : (gx > resolution ? resolution : gx);
+   gy = gy < 0.0 ? 0.0 : (gy > resolution ? resolution : gy);
+   gz = gz < 0.0 ? 0.0 : (gz > resolution ? resolution : gz);
+
+   int x0 = (int)gx < resolution - 1 ? (int)gx : resolution - 1;
+   int y0 = (int)gy < resolution - 1 ? (int)gy : resolution - 1;
+   int z0 = (int)gz < resolution - 1 ? (int)gz : resolution - 1;
+
+   if (x0 < 0) x0 = 0;
+   if (y0 < 0) y0 = 0;
+   if (z0 < 0) z0 = 0;
+
+   double fx = gx - x0;
+   double fy = gy - y0;
+   double fz = gz - z0;
+   int corners = resolution + 1;
+   const Color* slice = &grid[((size_t)z0 * corners + y0) * corners + x0];
+   size_t stepY = corners;
+   size_t stepZ = (size_t)corners * corners;
+
+   Color c00 = slice[0] * (1.0 - fx) + slice[1] * fx;
+   Color c10 = slice[stepY] * (1.0 - fx) + slice[stepY + 1] * fx;
+   Color c01 = slice[stepZ] * (1.0 - fx) + slice[stepZ + 1] * fx;
+   Color c11 = slice[stepZ + stepY] * (1.0 - fx) +
+    slice[stepZ + stepY + 1] * fx;
+
+   Color c0 = c00 * (1.0 - fy) + c10 * fy;
+   Color c1 = c01 * (1.0 - fy) + c11 * fy;
+
+   return c0 * (1.0 - fz) + c1 * fz;
+}
@@ -0,0 +1,35 @@
+#ifndef __BAKED_H__
+#define __BAKED_H__
+
+#include <vector>
+#include "Material.h"
+#include "Vector.h"
+
+/**
+ * Bakes another material's procedural pattern into a 3D lookup grid at
+ * load time and answers getColor with one trilinear fetch. Wraps the
+ * multi-octave noise materials (Marble, Wood, Turbulence, ...) whose
+ * per-hit evaluation cost dwarfs a grid read; the wrapped material's
+ * shading parameters and normal map carry over unchanged. Resolution
+ * and the world bounds to bake over come from the scene file.
+ */
+class Baked : public Material {
+private:
+   Material* source;
+   Vector minBound;
+   Vector cellScale; // Grid cells per world unit on each axis.
+   int resolution;
+   std::vector<Color> grid; // (resolution + 1)^3 corner samples.
+
+public:
+   Baked(Material* source_, int resolution_, const Vector& minBound_,
+    const Vector& maxBound_);
+
+   virtual Color getColor(Vector);
+
+   size_t bytes() const {
+      return grid.capacity() * sizeof(Color);
+   }
+};
+
+#endif
@@ -11,6 +11,14 @@ double Boundaries::splitValue(char axis) {
    }
 }
 
+double Boundaries::surfaceArea() {
+   double dx = max.x - min.x;
+   double dy = max.y - min.y;
+   double dz = max.z - min.z;
+
+   return 2 * (dx * dy + dy * dz + dz * dx);
+}
+
 /**
  * Ray axis aligned bounding box intersection.
  * Adapted from: http://gamedev.stackexchange.com/a/18459
@@ -38,5 +46,35 @@ bool Boundaries::intersect(const Ray& ray, double* dist) {
       return false;
    }
 
+   // Entry distance, clamped to zero when the origin is inside the box.
+   if (dist != NULL) {
+      *dist = tmin > 0 ? tmin : 0;
+   }
+
    return true;
 }
+
+/**
+ * Slab test for a whole ray packet at once. Written as branch-free
+ * fixed-trip loops over the packet so the compiler can vectorize the six
+ * multiplies and the min/max reduction across rays.
+ */
+void Boundaries::intersectPacket(const Ray rays[], int count, bool hits[],
+ double dists[]) {
+   for (int i = 0; i < count; i++) {
+      double t1 = (min.x - rays[i].origin.x) * rays[i].fracDir.x;
+      double t2 = (max.x - rays[i].origin.x) * rays[i].fracDir.x;
+      double t3 = (min.y - rays[i].origin.y) * rays[i].fracDir.y;
+      double t4 = (max.y - rays[i].origin.y) * rays[i].fracDir.y;
+      double t5 = (min.z - rays[i].origin.z) * rays[i].fracDir.z;
+      double t6 = (max.z - rays[i].origin.z) * rays[i].fracDir.z;
+
+      double tmin = std::max(std::max(std::min(t1, t2), std::min(t3, t4)),
+       std::min(t5, t6));
+      double tmax = std::min(std::min(std::max(t1, t2), std::max(t3, t4)),
+       std::max(t5, t6));
+
+      hits[i] = tmax >= 0 && tmin <= tmax;
+      dists[i] = tmin > 0 ? tmin : 0;
+   }
+}
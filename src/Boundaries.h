@@ -11,7 +11,9 @@ public:
    Boundaries() : min(Vector(0, 0, 0)), max(Vector(0, 0, 0)) {}
 
    double splitValue(char axis);
+   double surfaceArea();
    bool intersect(const Ray&, double* dist);
+   void intersectPacket(const Ray rays[], int count, bool hits[], double dists[]);
 };
 
 #endif
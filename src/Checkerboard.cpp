@@ -5,7 +5,7 @@
 // Offset points to move the origin which makes an ugly seam.
 #define POINT_OFFSET 3893343
 
-Checkerboard::Checkerboard(std::istream& in) {
+Checkerboard::Checkerboard(std::istream& in) : Material(MATERIAL_CHECKERBOARD) {
    in >> color1.r >> color1.g >> color1.b;
    in >> color2.r >> color2.g >> color2.b;
    in >> scale;
@@ -24,11 +24,3 @@ Color Checkerboard::getColor(Vector point) {
       return color2;
    }
 }
-
-double Checkerboard::getShininess() {
-   return shininess;
-}
-
-double Checkerboard::getReflectivity() {
-   return reflectivity;
-}
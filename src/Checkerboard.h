@@ -8,15 +8,11 @@ private:
    Color color1;
    Color color2;
    double scale;
-   double shininess;
-   double reflectivity;
 
 public:
    Checkerboard(std::istream&);
 
    virtual Color getColor(Vector);
-   virtual double getShininess();
-   virtual double getReflectivity();
 };
 
 #endif
@@ -3,14 +3,14 @@
 Color Color::operator+ (Color const &c) const {
    Color other;
 
-   other.r = NTZ(c.r) + NTZ(r);
-   other.g = NTZ(c.g) + NTZ(g);
-   other.b = NTZ(c.b) + NTZ(b);
+   other.r = NAN_GUARD(c.r) + NAN_GUARD(r);
+   other.g = NAN_GUARD(c.g) + NAN_GUARD(g);
+   other.b = NAN_GUARD(c.b) + NAN_GUARD(b);
 
    return other;
 }
 
-Color Color::operator* (double amount) const {
+Color Color::operator* (Scalar amount) const {
    Color other;
 
    other.r = r * amount;
@@ -1,28 +1,38 @@
 #ifndef __COLOR_H__
 #define __COLOR_H__
 
+#include <math.h>
+
+#include "Scalar.h"
+
 /**
- * "NaN To Zero"
- * Converts a NaN value to zero. Otherwise adding values to NaN results in NaN.
- * When adding colors together we usually want to ignore it and use 0 instead.
+ * Release color arithmetic is straight-line: the pipeline is NaN-free by
+ * construction (degenerate normals and the refraction edge cases are
+ * handled at the producers), so the old per-channel isnan test - the
+ * hottest branch in the program - is gone. Build with
+ * NANCHECK=-DRT_NAN_ASSERT to make any NaN that slips back in fail
+ * loudly here instead of propagating into the frame.
  */
-#define NTZ(X) (isnan((X)) ? 0.0 : (X))
-
-#include <math.h>
+#ifdef RT_NAN_ASSERT
+#include <assert.h>
+#define NAN_GUARD(X) (assert(!isnan(X)), (X))
+#else
+#define NAN_GUARD(X) (X)
+#endif
 
-class Color {
+class RT_VECTOR_ALIGN Color {
 public:
-   double r;
-   double g;
-   double b;
-   double f; // "filter" or "alpha"
+   Scalar r;
+   Scalar g;
+   Scalar b;
+   Scalar f; // "filter" or "alpha"
 
    Color() : r(0.0), g(0.0), b(0.0), f(1.0) {}
-   Color(double r_, double g_, double b_) : r(r_), g(g_), b(b_), f(1.0) {}
-   Color(double r_, double g_, double b_, double f_) : r(r_), g(g_), b(b_), f(f_) {}
+   Color(Scalar r_, Scalar g_, Scalar b_) : r(r_), g(g_), b(b_), f(1.0) {}
+   Color(Scalar r_, Scalar g_, Scalar b_, Scalar f_) : r(r_), g(g_), b(b_), f(f_) {}
 
    Color operator + (Color const & c) const;
-   Color operator * (double amount) const;
+   Color operator * (Scalar amount) const;
 };
 
 #endif
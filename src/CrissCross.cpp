@@ -3,7 +3,7 @@
 #include "Vector.h"
 #include "Color.h"
 
-CrissCross::CrissCross(std::istream& in) {
+CrissCross::CrissCross(std::istream& in) : Material(MATERIAL_CRISS_CROSS) {
    in >> color1.r >> color1.g >> color1.b;
    in >> color2.r >> color2.g >> color2.b;
    in >> color3.r >> color3.g >> color3.b;
@@ -20,24 +20,49 @@ Color CrissCross::getColor(Vector point) {
    double noiseCoefB = 0;
    double noiseCoefC = 0;
 
-   for (int level = 1; level < 10; level++) {
-      noiseCoefA += (1.0f / level) * fabsf(perlin.noise(
-         level * 0.35 * x,
-         level * 0.05 * y,
-         level * z
-      ));
-
-      noiseCoefB += (1.0f / level) * fabsf(perlin.noise(
-         level * x,
-         level * 0.35 * y,
-         level * 0.05 * z
-      ));
-
-      noiseCoefC += (1.0f / level) * fabsf(perlin.noise(
-         level * 0.05 * x,
-         level * y,
-         level * 0.35 * z
-      ));
+   double nx[4], ny[4], nz[4], n[4];
+
+   // Each of the three directional sums runs its octaves four at a time
+   // through the batched noise kernel, in the same accumulation order as
+   // the old scalar loop.
+   for (int level = 1; level < 10; level += 4) {
+      int batch = 10 - level < 4 ? 10 - level : 4;
+
+      for (int i = 0; i < batch; i++) {
+         nx[i] = (level + i) * 0.35 * x;
+         ny[i] = (level + i) * 0.05 * y;
+         nz[i] = (level + i) * z;
+      }
+
+      perlin.noise4(nx, ny, nz, n, batch);
+
+      for (int i = 0; i < batch; i++) {
+         noiseCoefA += (1.0f / (level + i)) * fabsf(n[i]);
+      }
+
+      for (int i = 0; i < batch; i++) {
+         nx[i] = (level + i) * x;
+         ny[i] = (level + i) * 0.35 * y;
+         nz[i] = (level + i) * 0.05 * z;
+      }
+
+      perlin.noise4(nx, ny, nz, n, batch);
+
+      for (int i = 0; i < batch; i++) {
+         noiseCoefB += (1.0f / (level + i)) * fabsf(n[i]);
+      }
+
+      for (int i = 0; i < batch; i++) {
+         nx[i] = (level + i) * 0.05 * x;
+         ny[i] = (level + i) * y;
+         nz[i] = (level + i) * 0.35 * z;
+      }
+
+      perlin.noise4(nx, ny, nz, n, batch);
+
+      for (int i = 0; i < batch; i++) {
+         noiseCoefC += (1.0f / (level + i)) * fabsf(n[i]);
+      }
    }
    noiseCoefA = 0.5f * sinf((x + z) * 0.05f + noiseCoefA) + 0.5f;
    noiseCoefB = 0.5f * sinf((y + x) * 0.05f + noiseCoefB) + 0.5f;
@@ -47,11 +72,3 @@ Color CrissCross::getColor(Vector point) {
           (color2 * noiseCoefB + color3 * (1.0f - noiseCoefB)) * 0.25 +
           (color3 * noiseCoefC + color1 * (1.0f - noiseCoefC)) * 0.25;
 }
-
-double CrissCross::getShininess() {
-   return shininess;
-}
-
-double CrissCross::getReflectivity() {
-   return reflectivity;
-}
@@ -11,15 +11,11 @@ private:
    Color color2;
    Color color3;
    double scale;
-   double shininess;
-   double reflectivity;
 
 public:
    CrissCross(std::istream&);
 
    virtual Color getColor(Vector);
-   virtual double getShininess();
-   virtual double getReflectivity();
 };
 
 #endif
@@ -3,7 +3,7 @@
 #include "Vector.h"
 #include "Color.h"
 
-FlatColor::FlatColor(std::istream& in) {
+FlatColor::FlatColor(std::istream& in) : Material(MATERIAL_FLAT_COLOR) {
    in >> color.r >> color.g >> color.b;
 }
 
@@ -3,7 +3,7 @@
 #include "Vector.h"
 #include "Color.h"
 
-Glass::Glass(std::istream& in) {
+Glass::Glass(std::istream& in) : Material(MATERIAL_GLASS) {
    in >> refractiveIndex;
    in >> shininess;
 }
@@ -11,11 +11,3 @@ Glass::Glass(std::istream& in) {
 Color Glass::getColor(Vector point) {
    return Color(0.0, 0.0, 0.0);
 }
-
-double Glass::getRefractiveIndex() {
-   return refractiveIndex;
-}
-
-double Glass::getShininess() {
-   return shininess;
-}
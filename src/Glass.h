@@ -4,16 +4,10 @@
 #include "Material.h"
 
 class Glass : public Material {
-private:
-   double refractiveIndex;
-   double shininess;
-
 public:
    Glass(std::istream&);
 
    virtual Color getColor(Vector);
-   virtual double getRefractiveIndex();
-   virtual double getShininess();
 };
 
 #endif
@@ -5,6 +5,10 @@
  * Cal Poly, San Luis Obispo
  */
 
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
 #include "Image.h"
 
 Image::Image(int width, int height)
@@ -12,6 +16,8 @@ Image::Image(int width, int height)
     _width = width;
     _height = height;
     _max = 1.0;
+    _gamma = 1.0;
+    _yOffset = 0;
 
     _pixmap = (Color*)malloc(sizeof(Color) * _width * _height);
 }
@@ -29,66 +35,142 @@ void Image::WriteTga(const char *outfile, bool scale_color)
         perror("ERROR: Image::WriteTga() failed to open file for writing!\n");
         exit(EXIT_FAILURE);
     }
-    
+
+    // the global max is found here, in the one pass that needs it, instead
+    // of branch-updating it on every pixel store during the render
+    if (scale_color)
+    {
+        for (int i = 0; i < _width * _height; i++)
+        {
+            Color* color = _pixmap + i;
+            _max = (color->r > _max) ? color->r : _max;
+            _max = (color->g > _max) ? color->g : _max;
+            _max = (color->b > _max) ? color->b : _max;
+        }
+    }
+
     // write 24-bit uncompressed targa header
     // thanks to Paul Bourke (http://local.wasp.uwa.edu.au/~pbourke/dataformats/tga/)
-    putc(0, fp);
-    putc(0, fp);
-    
-    putc(2, fp); // type is uncompressed RGB
-    
-    putc(0, fp);
-    putc(0, fp);
-    putc(0, fp);
-    putc(0, fp);
-    putc(0, fp);
-    
-    putc(0, fp); // x origin, low byte
-    putc(0, fp); // x origin, high byte
-    
-    putc(0, fp); // y origin, low byte
-    putc(0, fp); // y origin, high byte
+    unsigned char header[18];
+    memset(header, 0, sizeof(header));
+
+    header[2] = 2; // type is uncompressed RGB
+    header[12] = _width & 0xff; // width, low byte
+    header[13] = (_width & 0xff00) >> 8; // width, high byte
+    header[14] = _height & 0xff; // height, low byte
+    header[15] = (_height & 0xff00) >> 8; // height, high byte
+    header[16] = 24; // 24-bit color depth
 
-    putc(_width & 0xff, fp); // width, low byte
-    putc((_width & 0xff00) >> 8, fp); // width, high byte
+    fwrite(header, sizeof(header), 1, fp);
 
-    putc(_height & 0xff, fp); // height, low byte
-    putc((_height & 0xff00) >> 8, fp); // height, high byte
+    // quantize the whole frame in parallel into an 8-bit buffer, then dump
+    // it with one fwrite - the writer never touches float pixels
+    unsigned char *frame = (unsigned char*)malloc(3 * _width * _height);
 
-    putc(24, fp); // 24-bit color depth
+    Quantize(frame, scale_color);
+    fwrite(frame, 3 * _width * _height, 1, fp);
 
-    putc(0, fp);
+    free(frame);
+    fclose(fp);
+}
 
-    // write the raw pixel data in groups of 3 bytes (BGR order)
+void Image::Quantize(unsigned char *dst, bool scale_color)
+{
+    // rows are independent, so the clamp/gamma/quantize math fans out
+    // across threads; the pixmap is row-major so each thread streams
+    // through memory instead of striding across columns
+    #pragma omp parallel for
     for (int y = 0; y < _height; y++)
     {
-        for (int x = 0; x < _width; x++)
+        QuantizeRow(_yOffset + y, scale_color, dst + 3 * _width * y);
+    }
+}
+
+int Image::OpenTgaStream(const char *outfile, int full_height)
+{
+    int fileHeight = (full_height > 0) ? full_height : _height;
+
+    int fd = open(outfile, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        perror("ERROR: Image::OpenTgaStream() failed to open file for writing!\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // same 24-bit uncompressed targa header WriteTga emits
+    unsigned char header[18];
+    memset(header, 0, sizeof(header));
+
+    header[2] = 2; // type is uncompressed RGB
+    header[12] = _width & 0xff; // width, low byte
+    header[13] = (_width & 0xff00) >> 8; // width, high byte
+    header[14] = fileHeight & 0xff; // height, low byte
+    header[15] = (fileHeight & 0xff00) >> 8; // height, high byte
+    header[16] = 24; // 24-bit color depth
+
+    pwrite(fd, header, sizeof(header), 0);
+
+    return fd;
+}
+
+void Image::WriteTgaRows(int fd, int y_start, int y_end)
+{
+    int bytesPerRow = 3 * _width;
+    unsigned char *band = (unsigned char*)malloc(bytesPerRow * (y_end - y_start));
+
+    // streamed rows use the clamped quantization (WriteTga's
+    // scale_color = false path) since the global max isn't known until
+    // the whole frame is done
+    for (int y = y_start; y < y_end; y++)
+    {
+        QuantizeRow(y, false, band + bytesPerRow * (y - y_start));
+    }
+
+    pwrite(fd, band, bytesPerRow * (y_end - y_start),
+           18 + (off_t)y_start * bytesPerRow);
+
+    free(band);
+}
+
+void Image::QuantizeRow(int y, bool scale_color, unsigned char *dst)
+{
+    Color* scanline = _pixmap + ((y - _yOffset) * _width);
+
+    for (int x = 0; x < _width; x++)
+    {
+        unsigned char rbyte, gbyte, bbyte;
+        Color* color = scanline + x;
+        if (scale_color)
         {
-            // if color scaling is on, scale 0.0 -> _max as a 0 -> 255 unsigned byte
-            unsigned char rbyte, gbyte, bbyte;
-            Color* color = _pixmap + (x * _height + y);
-            if (scale_color)
-            {
-                rbyte = (unsigned char)((color->r / _max) * 255);
-                gbyte = (unsigned char)((color->g / _max) * 255);
-                bbyte = (unsigned char)((color->b / _max) * 255);
-            }
-            else
+            // scale 0.0 -> _max as a 0 -> 255 unsigned byte
+            rbyte = (unsigned char)((color->r / _max) * 255);
+            gbyte = (unsigned char)((color->g / _max) * 255);
+            bbyte = (unsigned char)((color->b / _max) * 255);
+        }
+        else
+        {
+            double r = (color->r > 1.0) ? 1.0 : color->r;
+            double g = (color->g > 1.0) ? 1.0 : color->g;
+            double b = (color->b > 1.0) ? 1.0 : color->b;
+
+            // gamma encode after the clamp; skipped entirely at 1.0 so the
+            // default output stays bit-for-bit what it always was
+            if (_gamma != 1.0)
             {
-                double r = (color->r > 1.0) ? 1.0 : color->r;
-                double g = (color->g > 1.0) ? 1.0 : color->g;
-                double b = (color->b > 1.0) ? 1.0 : color->b;
-                rbyte = (unsigned char)(r * 255);
-                gbyte = (unsigned char)(g * 255);
-                bbyte = (unsigned char)(b * 255);
+                double invGamma = 1.0 / _gamma;
+                r = pow(r, invGamma);
+                g = pow(g, invGamma);
+                b = pow(b, invGamma);
             }
-            putc(bbyte, fp);
-            putc(gbyte, fp);
-            putc(rbyte, fp);
+
+            rbyte = (unsigned char)(r * 255);
+            gbyte = (unsigned char)(g * 255);
+            bbyte = (unsigned char)(b * 255);
         }
+        dst[3 * x] = bbyte;
+        dst[3 * x + 1] = gbyte;
+        dst[3 * x + 2] = rbyte;
     }
-
-    fclose(fp);
 }
 
 void Image::GenTestPattern()
@@ -162,32 +244,31 @@ void Image::GenTestPattern()
 
 Color Image::pixel(int x, int y)
 {
+    int row = y - _yOffset;
+
     if (x < 0 || x > _width - 1 ||
-        y < 0 || y > _height - 1)
+        row < 0 || row > _height - 1)
     {
         // catostrophically fail
         fprintf(stderr, "ERROR: Image::pixel(%d, %d) outside range of the image!\n", x, y);
         exit(EXIT_FAILURE);
     }
-    
-    return _pixmap[x * _height + y];
+
+    return _pixmap[row * _width + x];
 }
 
 void Image::pixel(int x, int y, Color pxl)
 {
+    int row = y - _yOffset;
+
     if (x < 0 || x > _width - 1 ||
-        y < 0 || y > _height - 1)
+        row < 0 || row > _height - 1)
     {
         // catostrophically fail
         fprintf(stderr, "ERROR: Image::pixel(%d, %d, pixel) outside range of the image!\n", x, y);
         exit(EXIT_FAILURE);
     }
-    
-    _pixmap[x * _height + y] = pxl;
 
-    // update the max color if necessary
-    _max = (pxl.r > _max) ? pxl.r : _max;
-    _max = (pxl.g > _max) ? pxl.g : _max;
-    _max = (pxl.b > _max) ? pxl.b : _max;
+    _pixmap[row * _width + x] = pxl;
 }
 
@@ -23,6 +23,21 @@ public:
     // to the global max, otherwise it will be clamped at 1.0
     void WriteTga(const char *outfile, bool scale_color = true);
 
+    // explicit post-processing pass: clamp or scale, optional gamma, and
+    // 0-255 quantization into a BGR byte buffer (3 bytes per pixel), rows
+    // fanned out across OpenMP threads. Any future framebuffer filter
+    // belongs here, upstream of the writers.
+    void Quantize(unsigned char *dst, bool scale_color);
+
+    // streaming output: OpenTgaStream writes the targa header and returns a
+    // file descriptor, WriteTgaRows quantizes scanlines [y_start, y_end) and
+    // pwrites them at their final file offsets. Rows land positionally, so
+    // bands may be flushed in any order and from any thread.
+    // full_height overrides the header height for out-of-core renders,
+    // where the Image is only a band of a taller frame
+    int OpenTgaStream(const char *outfile, int full_height = 0);
+    void WriteTgaRows(int fd, int y_start, int y_end);
+
     void GenTestPattern();
 
     // property accessors
@@ -32,11 +47,26 @@ public:
     int height() const { return _height; }
     double max() const { return _max; }
 
+    // display gamma applied during quantization (1.0 leaves the old
+    // linear output untouched)
+    double gamma() const { return _gamma; }
+    void gamma(double g) { _gamma = g; }
+
+    // window origin for out-of-core rendering: the pixmap backs rows
+    // [yOffset, yOffset + height) of a taller frame, and pixel() /
+    // WriteTgaRows keep taking full-frame y coordinates
+    int yOffset() const { return _yOffset; }
+    void yOffset(int y0) { _yOffset = y0; }
+
 private:
     int _width;
     int _height;
-    Color *_pixmap;
+    Color *_pixmap; // row-major: _pixmap[y * _width + x]
     double _max;
+    double _gamma;
+    int _yOffset;
+
+    void QuantizeRow(int y, bool scale_color, unsigned char *dst);
 };
 
 #endif
@@ -0,0 +1,72 @@
+#include "Instance.h"
+#include "BSP.h"
+#include "Intersection.h"
+
+/**
+ * Uniform scale plus translation: only the origin moves between spaces.
+ * The direction (and therefore fracDir) is unchanged, and distances just
+ * scale by 1/scale, so the copied ray keeps its material and sampler.
+ */
+static Ray toObjectSpace(const Ray& ray, double scale,
+ const Vector& translate) {
+   Ray objectRay = ray;
+
+   objectRay.origin = (ray.origin - translate) * (1.0 / scale);
+
+   return objectRay;
+}
+
+bool Instance::intersect(const Ray& ray, double tMax, Hit& hit) {
+   Ray objectRay = toObjectSpace(ray, scale, translate);
+   Hit objectHit;
+
+   // Seed the inner traversal with the caller's best distance so faces
+   // behind it prune exactly like they would in a flat tree.
+   objectHit.distance = tMax / scale;
+   model->tree->getClosestHit(objectRay, objectHit);
+
+   if (objectHit.object == NULL) {
+      return false;
+   }
+
+   hit.distance = objectHit.distance * scale;
+   hit.object = this;
+
+   return true;
+}
+
+Intersection Instance::getIntersection(const Ray& ray, const Hit& hit) {
+   // Re-find the winning face in object space; traversal is deterministic
+   // so this recovers the same face intersect() saw. The normal survives
+   // the uniform scale and translation unchanged.
+   Ray objectRay = toObjectSpace(ray, scale, translate);
+   Hit objectHit;
+
+   model->tree->getClosestHit(objectRay, objectHit);
+
+   if (objectHit.object == NULL) {
+      return Intersection();
+   }
+
+   Intersection inner = objectHit.object->getIntersection(objectRay,
+    objectHit);
+   Vector point = ray.origin + Vector(hit.distance) * ray.direction;
+
+   return Intersection(ray, point, hit.distance, inner.normal, ray.material,
+    material, this);
+}
+
+bool Instance::anyIntersection(const Ray& ray, double maxDistance) {
+   Ray objectRay = toObjectSpace(ray, scale, translate);
+
+   return model->tree->anyIntersection(objectRay, maxDistance / scale) != NULL;
+}
+
+Boundaries Instance::getBounds() {
+   Boundaries bounds;
+
+   bounds.min = model->bounds.min * scale + translate;
+   bounds.max = model->bounds.max * scale + translate;
+
+   return bounds;
+}
@@ -0,0 +1,54 @@
+#ifndef __INSTANCE_H__
+#define __INSTANCE_H__
+
+#include <vector>
+#include "Vector.h"
+#include "Object.h"
+#include "Boundaries.h"
+#include "Mesh.h"
+
+class BSP;
+class Material;
+
+/**
+ * One model shared by every Instance that places it: the object-space
+ * mesh (centered at the origin and scaled to a unit bounding diagonal),
+ * a BSP over its faces and the cached object-space bounds. Built once
+ * per distinct model file no matter how many placements reference it.
+ */
+class InstancedModel {
+public:
+   Mesh* mesh;
+   std::vector<Object*> faces;
+   BSP* tree;
+   Boundaries bounds;
+
+   InstancedModel() : mesh(NULL), tree(NULL) {}
+};
+
+/**
+ * A placement of a shared model. Rays are transformed into the model's
+ * object space (the inverse of the instance's uniform scale and
+ * translation - the same transform the model keyword bakes into its
+ * vertices) and traverse the model's own BSP, so the top-level tree only
+ * sees one lightweight object per placement and N placements share one
+ * copy of the geometry.
+ */
+class Instance : public Object {
+public:
+   InstancedModel* model;
+   double scale;
+   Vector translate;
+   Material* material;
+
+   Instance(InstancedModel* model_, double scale_, Vector translate_,
+    Material* material_) : model(model_), scale(scale_),
+    translate(translate_), material(material_) {}
+
+   virtual bool intersect(const Ray&, double tMax, Hit&);
+   virtual Intersection getIntersection(const Ray&, const Hit&);
+   virtual bool anyIntersection(const Ray&, double maxDistance);
+   virtual Boundaries getBounds();
+};
+
+#endif
@@ -8,6 +8,19 @@
 #include "Ray.h"
 #include "Material.h"
 
+/**
+ * Slim mutable hit record filled in-place during traversal. Only the
+ * winning hit gets materialized into a full Intersection, so the hot loop
+ * never copies Ray or Intersection structs around.
+ */
+class Hit {
+public:
+   double distance;
+   Object* object;
+
+   Hit() : distance(std::numeric_limits<double>::max()), object(NULL) {}
+};
+
 class Intersection {
 public:
    Ray ray;
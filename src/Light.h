@@ -7,9 +7,15 @@ class Light {
 public:
    Vector position;
    double intensity;
+   double radius; // Sphere radius; 0 is a point light with hard shadows.
+   int samples; // Stratified shadow rays per shading point when radius > 0.
 
    Light(Vector position_, double intensity_) :
-    position(position_), intensity(intensity_) {}
+    position(position_), intensity(intensity_), radius(0.0), samples(1) {}
+
+   Light(Vector position_, double intensity_, double radius_, int samples_) :
+    position(position_), intensity(intensity_), radius(radius_),
+    samples(samples_) {}
 };
 
 #endif
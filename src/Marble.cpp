@@ -3,7 +3,7 @@
 #include "Vector.h"
 #include "Color.h"
 
-Marble::Marble(std::istream& in) {
+Marble::Marble(std::istream& in) : Material(MATERIAL_MARBLE) {
    in >> color1.r >> color1.g >> color1.b;
    in >> color2.r >> color2.g >> color2.b;
    in >> scale;
@@ -16,23 +16,26 @@ Color Marble::getColor(Vector point) {
    double y = point.y * scale;
    double z = point.z * scale;
    double noiseCoef = 0;
+   double nx[4], ny[4], nz[4], n[4];
 
-   for (int level = 1; level < 10; level ++) {
-      noiseCoef +=  (1.0f / level) * fabsf(perlin.noise(
-         level * 0.05 * x,
-         level * 0.15 * y,
-         level * 0.05 * z
-      ));
+   // Octaves run four at a time through the batched noise kernel; the
+   // accumulation order matches the old scalar loop exactly.
+   for (int level = 1; level < 10; level += 4) {
+      int batch = 10 - level < 4 ? 10 - level : 4;
+
+      for (int i = 0; i < batch; i++) {
+         nx[i] = (level + i) * 0.05 * x;
+         ny[i] = (level + i) * 0.15 * y;
+         nz[i] = (level + i) * 0.05 * z;
+      }
+
+      perlin.noise4(nx, ny, nz, n, batch);
+
+      for (int i = 0; i < batch; i++) {
+         noiseCoef += (1.0f / (level + i)) * fabsf(n[i]);
+      }
    }
    noiseCoef = 0.5f * sinf((x + y) * 0.05f + noiseCoef) + 0.5f;
 
    return color1 * noiseCoef + color2 * (1.0f - noiseCoef);
 }
-
-double Marble::getShininess() {
-   return shininess;
-}
-
-double Marble::getReflectivity() {
-   return reflectivity;
-}
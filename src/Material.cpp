@@ -5,16 +5,10 @@
  * Put Material code here!
  */
 
-double Material::getShininess() {
-   return NOT_SHINY;
-}
-
-double Material::getReflectivity() {
-   return NOT_REFLECTIVE;
-}
-
-double Material::getRefractiveIndex() {
-   return NOT_REFRACTIVE;
+void Material::getColors(const Vector points[], int count, Color out[]) {
+   for (int i = 0; i < count; i++) {
+      out[i] = getColor(points[i]);
+   }
 }
 
 Vector Material::modifyNormal(const Vector& normal, const Vector& point) {
@@ -15,17 +15,58 @@ class Vector;
 class Color;
 class NormalMap;
 
+/**
+ * Identifies the concrete material so shading code can group or switch on
+ * hits without touching the vtable.
+ */
+enum MaterialType {
+   MATERIAL_FLAT_COLOR,
+   MATERIAL_SHINY_COLOR,
+   MATERIAL_CHECKERBOARD,
+   MATERIAL_GLASS,
+   MATERIAL_AIR,
+   MATERIAL_MARBLE,
+   MATERIAL_WOOD,
+   MATERIAL_TURBULENCE,
+   MATERIAL_CRISS_CROSS,
+   MATERIAL_BAKED
+};
+
 class Material {
 private:
    NormalMap* normalMap;
 
+protected:
+   // The scalar shading parameters live packed in the base object and are
+   // filled in by subclass constructors, so the getters below are plain
+   // inline field reads instead of one virtual dispatch each per
+   // intersection. Only getColor still needs the vtable.
+   double shininess;
+   double reflectivity;
+   double refractiveIndex;
+
 public:
+   MaterialType type;
+
+   Material(MaterialType type_) : normalMap(NULL), shininess(NOT_SHINY),
+    reflectivity(NOT_REFLECTIVE), refractiveIndex(NOT_REFRACTIVE),
+    type(type_) {}
+
    void setNormalMap(NormalMap* normalMap_) { normalMap = normalMap_; }
+   NormalMap* getNormalMap() const { return normalMap; }
 
    virtual Color getColor(Vector) = 0;
-   virtual double getShininess();
-   virtual double getReflectivity();
-   virtual double getRefractiveIndex();
+
+   /**
+    * Batch evaluation for several hit points of the same material. The
+    * default just loops over getColor; texture materials with batched
+    * kernels can override to amortize their noise evaluation.
+    */
+   virtual void getColors(const Vector points[], int count, Color out[]);
+
+   double getShininess() const { return shininess; }
+   double getReflectivity() const { return reflectivity; }
+   double getRefractiveIndex() const { return refractiveIndex; }
 
    Vector modifyNormal(const Vector&, const Vector&);
 };
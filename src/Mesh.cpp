@@ -0,0 +1,79 @@
+#include <algorithm>
+#include <math.h>
+#include "Mesh.h"
+#include "Material.h"
+
+bool MeshTriangle::intersect(const Ray& ray, double tMax, Hit& hit) {
+  const Vector& p0 = mesh->vertices[v0];
+  const Vector& p1 = mesh->vertices[v1];
+  const Vector& p2 = mesh->vertices[v2];
+
+  Vector e1, e2, h, s, q;
+  double a, f, u, v, distance;
+
+  e1 = p1 - p0;
+  e2 = p2 - p0;
+
+  h = ray.direction.cross(e2);
+  a = e1.dot(h);
+
+  if (a > -0.00001 && a < 0.00001)
+     return false;
+
+  f = 1 / a;
+  s = ray.origin - p0;
+
+  u = f * s.dot(h);
+
+  if (u < 0.0 || u > 1.0)
+     return false;
+
+  q = s.cross(e1);
+  v = f * ray.direction.dot(q);
+
+  if (v < 0.0 || u + v > 1.0)
+     return false;
+
+  distance = f * e2.dot(q);
+
+  // Ray Intersection
+  if (distance > 0.00001 && distance < tMax) {
+     hit.distance = distance;
+     hit.object = this;
+
+     return true;
+  }
+
+  return false;
+}
+
+Intersection MeshTriangle::getIntersection(const Ray& ray, const Hit& hit) {
+   Vector point = ray.origin + Vector(hit.distance) * ray.direction;
+
+   return Intersection(ray, point, hit.distance, normal, ray.material,
+    mesh->material, this);
+}
+
+bool MeshTriangle::anyIntersection(const Ray& ray, double maxDistance) {
+   Hit hit;
+
+   return intersect(ray, maxDistance, hit);
+}
+
+Boundaries MeshTriangle::getBounds() {
+   const Vector& p0 = mesh->vertices[v0];
+   const Vector& p1 = mesh->vertices[v1];
+   const Vector& p2 = mesh->vertices[v2];
+
+   Boundaries bounds;
+
+   bounds.min = Vector(std::min(p0.x, std::min(p1.x, p2.x)),
+                       std::min(p0.y, std::min(p1.y, p2.y)),
+                       std::min(p0.z, std::min(p1.z, p2.z)));
+
+   bounds.max = Vector(std::max(p0.x, std::max(p1.x, p2.x)),
+                       std::max(p0.y, std::max(p1.y, p2.y)),
+                       std::max(p0.z, std::max(p1.z, p2.z)));
+
+   return bounds;
+}
@@ -0,0 +1,63 @@
+#ifndef __MESH_H__
+#define __MESH_H__
+
+#include <math.h>
+#include <vector>
+#include "Vector.h"
+#include "Ray.h"
+#include "Intersection.h"
+#include "Object.h"
+#include "Boundaries.h"
+
+class Material;
+
+/**
+ * Indexed triangle mesh for model geometry. All vertices live in one
+ * contiguous buffer shared between faces so adjacent triangles don't
+ * duplicate their corners like standalone Triangle objects do.
+ */
+class Mesh {
+public:
+   std::vector<Vector> vertices;
+   Material* material;
+
+   Mesh(Material* material_) : material(material_) {}
+};
+
+/**
+ * One face of a Mesh. Stores three indices into the mesh's vertex buffer
+ * instead of three full vertices plus cached bounds. The unit normal is
+ * precomputed since it never changes; edges stay in the shared vertex
+ * buffer to keep faces small.
+ */
+class MeshTriangle : public Object {
+public:
+   Mesh* mesh;
+   int v0, v1, v2;
+   Vector normal;
+
+   MeshTriangle(Mesh* mesh_, int v0_, int v1_, int v2_) :
+    mesh(mesh_), v0(v0_), v1(v1_), v2(v2_) {
+      const Vector& p0 = mesh->vertices[v0];
+      const Vector& p1 = mesh->vertices[v1];
+      const Vector& p2 = mesh->vertices[v2];
+
+      Vector area = (p1 - p0).cross(p2 - p0);
+
+      // Scanned models ship the occasional zero-area face; it can never
+      // be hit, but normalizing its zero cross product would seed NaNs
+      // into the lighting math, so give it an arbitrary finite normal.
+      if (area.dot(area) == 0.0) {
+         area = Vector(0.0, 0.0, 1.0);
+      }
+
+      normal = area.normalize();
+   }
+
+   virtual bool intersect(const Ray&, double tMax, Hit&);
+   virtual Intersection getIntersection(const Ray&, const Hit&);
+   virtual bool anyIntersection(const Ray&, double maxDistance);
+   virtual Boundaries getBounds();
+};
+
+#endif
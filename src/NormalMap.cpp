@@ -11,9 +11,17 @@ Vector NormalMap::modifyNormal(const Vector& normal, const Vector& point) {
    double y = point.y / scale;
    double z = point.z / scale;
 
-   noise.x = (float)(perlin.noise(x, y, z));
-   noise.y = (float)(perlin.noise(y, z, x));
-   noise.z = (float)(perlin.noise(z, x, y));
+   // The three rotated lookups batch into one kernel call.
+   double xs[3] = {x, y, z};
+   double ys[3] = {y, z, x};
+   double zs[3] = {z, x, y};
+   double n[3];
+
+   perlin.noise4(xs, ys, zs, n, 3);
+
+   noise.x = (float)n[0];
+   noise.y = (float)n[1];
+   noise.z = (float)n[2];
 
    return (normal + noise * amount).normalize();
 }
@@ -1,6 +1,7 @@
 #ifndef __OBJECT_H__
 #define __OBJECT_H__
 
+class Hit;
 class Intersection;
 class Boundaries;
 class Ray;
@@ -10,7 +11,26 @@ class Ray;
  */
 class Object {
 public:
-   virtual Intersection intersect(Ray) = 0;
+   /**
+    * Tests the ray against this object and updates the hit record if a hit
+    * beats tMax, returning whether it did. This is the cheap kernel - all
+    * normal and material work is deferred to getIntersection, which is
+    * called once per ray for the winning hit only.
+    */
+   virtual bool intersect(const Ray&, double tMax, Hit&) = 0;
+
+   /**
+    * Materializes the full shading Intersection for a hit produced by
+    * intersect.
+    */
+   virtual Intersection getIntersection(const Ray&, const Hit&) = 0;
+
+   /**
+    * Returns whether the ray hits this object within maxDistance. Skips all
+    * normal and material work so shadow rays stay cheap.
+    */
+   virtual bool anyIntersection(const Ray&, double maxDistance) = 0;
+
    virtual Boundaries getBounds() = 0;
 };
 
@@ -17,6 +17,8 @@ public:
    PerlinNoise();
 
    double noise(double, double, double);
+   void noise4(const double* xs, const double* ys, const double* zs,
+    double* out, int count);
 };
 
 #endif
@@ -5,6 +5,7 @@
 #include "Vector.h"
 
 class Material;
+class Sampler;
 
 class Ray {
 public:
@@ -14,14 +15,21 @@ public:
    int reflectionsRemaining;
    Material* material;
 
+   // Accumulated contribution of this ray to the final pixel (1.0 for
+   // primary rays, scaled down at every reflective/refractive bounce),
+   // and the pixel's sampler for Russian-roulette draws. The sampler
+   // stays NULL on rays that never recurse (shadow rays).
+   double throughput;
+   Sampler* sampler;
+
    Ray() : origin(Vector()), direction(Vector()), reflectionsRemaining(-1),
-    material(NULL) {
+    material(NULL), throughput(1.0), sampler(NULL) {
       calcFracDirection();
    }
 
    Ray(Vector origin_, Vector direction_, int reflections,
     Material* material_) : origin(origin_), reflectionsRemaining(reflections),
-    material(material_) {
+    material(material_), throughput(1.0), sampler(NULL) {
       direction = direction_.normalize();
 
       /* Move intersection slightly forward to avoid intersecting with itself. */
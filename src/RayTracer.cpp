@@ -1,4 +1,16 @@
+#include <algorithm>
 #include <limits>
+#include <sstream>
+#include <omp.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
 #include "RayTracer.h"
 #include "Image.h"
 #include "Object.h"
@@ -16,108 +28,1507 @@
 #include "NormalMap.h"
 #include "Turbulence.h"
 #include "CrissCross.h"
+#include "Baked.h"
+#include "Mesh.h"
+#include "Instance.h"
 #include "BSP.h"
+#include "RenderStats.h"
+#include "Sampler.h"
 
 using namespace std;
 
 RayTracer::RayTracer(int width_, int height_, int maxReflections_, int superSamples_,
  int depthComplexity_) : width(width_), height(height_),
- maxReflections(maxReflections_), superSamples(superSamples_), camera(Camera()),
- imageScale(1), depthComplexity(depthComplexity_), dispersion(5.0f), raysCast(0),
- startingMaterial(new Air()) {}
+ maxReflections(maxReflections_), superSamples(superSamples_), tileSize(32),
+ camera(Camera()), imageScale(1), depthComplexity(depthComplexity_),
+ dispersion(5.0f), adaptiveThreshold(0.0), dofThreshold(0.0),
+ lightCullThreshold(0.0),
+ rouletteThreshold(0.0), gamma(1.0), costHeatmap(0), wavefront(0),
+ sharedSamples(0), resume(0), outOfCore(0),
+ cameraFrames(1), progressive(0), memoryBudget(0), quiet(0),
+ startingMaterial(new Air()),
+ pixelKernel(&RayTracer::castRayForPixelKernel<0, false>),
+ materialBytes(0) {}
 
 RayTracer::~RayTracer() {
-   for (vector<Object*>::iterator itr = objects.begin(); itr < objects.end(); itr++) {
+   // Primitives are owned by the typed arenas and freed en masse there.
+
+   for (vector<Mesh*>::iterator itr = meshes.begin(); itr < meshes.end(); itr++) {
+      delete *itr;
+   }
+
+   for (vector<Light*>::iterator itr = lights.begin(); itr < lights.end(); itr++) {
       delete *itr;
    }
 
-   for (vector<Light*>::iterator itr = lights.begin(); itr < lights.end(); itr++) {
-      delete *itr;
+   delete startingMaterial;
+}
+
+// Checkpoint sidecar layout: a header, the per-tile done bitmap, then the
+// raw Color framebuffer at fixed row-major offsets, so any thread can flush
+// its tile positionally without coordination. sizeof(Color) is baked into
+// the magic so a float-precision build never resumes a double one.
+#define CHECKPOINT_MAGIC (0x4b435452 + (unsigned int)sizeof(Color))
+
+// How often the progress reporter samples the shared tile counter.
+#define PROGRESS_INTERVAL_USEC 250000
+
+/**
+ * Renders one frame per camera keyframe step into numbered output files,
+ * so a whole turntable animation amortizes a single scene parse, model
+ * load and BSP build. Without a keyframe path this is just one frame.
+ */
+/**
+ * Fills the per-subsystem memory lines of the stats report: the geometry
+ * arenas and vertex buffers, the acceleration structures (the top-level
+ * tree plus every instanced model's own tree), the framebuffer the
+ * configured mode will allocate, and the material table. Numbers are
+ * slab- and capacity-granular, which is what the scheduler plans
+ * against - not allocator-exact.
+ */
+void RayTracer::accountMemory() {
+   unsigned long long geometry = sphereArena.bytes() +
+    triangleArena.bytes() + meshTriangleArena.bytes() +
+    objects.capacity() * sizeof(Object*);
+
+   for (vector<Mesh*>::iterator itr = meshes.begin(); itr < meshes.end();
+        itr++) {
+      geometry += (*itr)->vertices.capacity() * sizeof(Vector);
+   }
+
+   unsigned long long bspTotal = bsp == NULL ? 0 : bsp->memoryBytes();
+
+   for (map<string, InstancedModel*>::iterator itr = instancedModels.begin();
+        itr != instancedModels.end(); itr++) {
+      bspTotal += itr->second->tree->memoryBytes();
+      geometry += itr->second->faces.capacity() * sizeof(Object*);
+   }
+
+   int bufferRows = outOfCore ? min(tileSize, height) : height;
+
+   renderStats.geometryBytes = geometry;
+   renderStats.bspBytes = bspTotal;
+   renderStats.framebufferBytes = (unsigned long long)width * bufferRows *
+    sizeof(Color);
+   renderStats.materialBytes = materialBytes;
+}
+
+/**
+ * Budget mode: everything but the framebuffer is already resident by the
+ * time this runs, so an overrun either downgrades to the out-of-core
+ * band framebuffer (when that fits and the mode allows it) or fails fast
+ * here, before the render touches a farm node's memory limit.
+ */
+void RayTracer::enforceMemoryBudget() {
+   unsigned long long loaded = renderStats.geometryBytes +
+    renderStats.bspBytes + renderStats.materialBytes;
+
+   if (loaded + renderStats.framebufferBytes <= memoryBudget) {
+      return;
+   }
+
+   unsigned long long band = (unsigned long long)width *
+    min(tileSize, height) * sizeof(Color);
+
+   // Progressive and resumed renders need the whole frame in memory.
+   if (!outOfCore && !progressive && !resume &&
+    loaded + band <= memoryBudget) {
+      cout << "Memory budget: using out-of-core framebuffer" << endl;
+      outOfCore = 1;
+      renderStats.framebufferBytes = band;
+      return;
+   }
+
+   cerr << "Memory budget exceeded: need " <<
+    ((loaded + renderStats.framebufferBytes) >> 20) << " MB, budget " <<
+    (memoryBudget >> 20) << " MB" << endl;
+   exit(EXIT_FAILURE);
+}
+
+void RayTracer::traceRays(string fileName) {
+   accountMemory();
+
+   if (memoryBudget > 0) {
+      enforceMemoryBudget();
+   }
+
+   if (progressive) {
+      traceProgressive(fileName);
+      return;
+   }
+
+   if (cameraFrames < 2 || cameraKeyframes.size() < 2) {
+      traceFrame(fileName);
+      return;
+   }
+
+   size_t dot = fileName.rfind('.');
+   string base = dot == string::npos ? fileName : fileName.substr(0, dot);
+   string extension = dot == string::npos ? "" : fileName.substr(dot);
+
+   for (int frame = 0; frame < cameraFrames; frame++) {
+      // Walk the keyframe segments at a constant parametric rate.
+      double t = frame / (double)(cameraFrames - 1) *
+       (cameraKeyframes.size() - 1);
+      int segment = min((int)t, (int)cameraKeyframes.size() - 2);
+      double blend = t - segment;
+
+      Camera& from = cameraKeyframes[segment];
+      Camera& to = cameraKeyframes[segment + 1];
+
+      camera.position = from.position +
+       (to.position - from.position) * blend;
+      camera.lookAt = from.lookAt + (to.lookAt - from.lookAt) * blend;
+
+      char frameFile[1024];
+      snprintf(frameFile, sizeof(frameFile), "%s_%04d%s", base.c_str(),
+       frame, extension.c_str());
+
+      cout << "Frame " << (frame + 1) << "/" << cameraFrames << ": " <<
+       frameFile << endl;
+      traceFrame(frameFile);
+   }
+}
+
+void RayTracer::traceFrame(string fileName) {
+   if (outOfCore) {
+      traceBanded(fileName);
+      return;
+   }
+
+   camera.calculateWUV();
+   Image image(width, height);
+   image.gamma(gamma);
+
+   // Reset depthComplexity to avoid unnecessary loops.
+   if (dispersion < 0) {
+      depthComplexity = 1;
+   }
+
+   selectPixelKernel();
+   imageScale = camera.screenWidth / (float)width;
+
+   occluderCache.assign(omp_get_max_threads(),
+    vector<Object*>(lights.size(), (Object*)NULL));
+
+   if (costHeatmap) {
+      pixelCost.assign((size_t)width * height, 0.0);
+   }
+
+   int tilesAcross = (width + tileSize - 1) / tileSize;
+   int tilesDown = (height + tileSize - 1) / tileSize;
+   int tileCount = tilesAcross * tilesDown;
+   int nextTile = 0;
+   int tilesCompleted = 0;
+
+   // Output is pipelined with rendering: whichever thread finishes the
+   // last tile of a tile row quantizes that band and pwrites it at its
+   // final offset while the other threads keep rendering, so the file is
+   // done moments after the last tile is.
+   int outFd = image.OpenTgaStream(fileName.c_str());
+   vector<int> rowTilesDone(tilesDown, 0);
+
+   // Checkpoint sidecar: finished tiles are flushed raw as they complete,
+   // so a preempted render can be restarted with --resume and only redo
+   // the tiles that were in flight.
+   string checkpointFile = fileName + ".ckpt";
+   vector<unsigned char> tileDone(tileCount, 0);
+   int ckptFd = open(checkpointFile.c_str(), O_RDWR | O_CREAT, 0644);
+
+   if (ckptFd >= 0 && resume && readCheckpoint(ckptFd, tileDone, image)) {
+      for (int tile = 0; tile < tileCount; tile++) {
+         if (tileDone[tile]) {
+            tilesCompleted++;
+            rowTilesDone[tile / tilesAcross]++;
+         }
+      }
+
+      // Tile rows that were already whole go straight out to the targa.
+      for (int tileY = 0; tileY < tilesDown; tileY++) {
+         if (rowTilesDone[tileY] == tilesAcross) {
+            image.WriteTgaRows(outFd, tileY * tileSize,
+             min(tileY * tileSize + tileSize, height));
+         }
+      }
+
+      cout << "Resumed " << tilesCompleted << " of " << tileCount <<
+       " tiles from " << checkpointFile << endl;
+   } else if (ckptFd >= 0) {
+      // Fresh run (or a stale/mismatched checkpoint): reset the sidecar.
+      tileDone.assign(tileCount, 0);
+      ftruncate(ckptFd, 0);
+
+      unsigned int header[4] = { CHECKPOINT_MAGIC, (unsigned int)width,
+       (unsigned int)height, (unsigned int)tileSize };
+      pwrite(ckptFd, header, sizeof(header), 0);
+      pwrite(ckptFd, &tileDone[0], tileCount, sizeof(header));
+   }
+
+   double renderStart = omp_get_wtime();
+
+   // Tiles are pulled off a shared queue so threads that draw cheap
+   // background tiles just grab more work instead of going idle. Render
+   // threads only bump the shared counter; a dedicated extra thread (it
+   // sleeps through almost the whole render, so oversubscribing by one
+   // costs nothing) samples it on a fixed interval for the progress line.
+   // The old per-tile '\r' write serialized every thread on the stream
+   // lock and sprayed farm logs with control characters.
+   #pragma omp parallel num_threads(omp_get_max_threads() + 1)
+   {
+      if (omp_get_thread_num() == omp_get_num_threads() - 1) {
+         int completed = 0;
+
+         while (!quiet && completed < tileCount) {
+            usleep(PROGRESS_INTERVAL_USEC);
+
+            #pragma omp atomic read
+            completed = tilesCompleted;
+
+            cout << '\r' << (int)(completed / (float)tileCount * 100) << '%';
+            fflush(stdout);
+         }
+      } else {
+         for (;;) {
+            int tile;
+
+            #pragma omp atomic capture
+            tile = nextTile++;
+
+            if (tile >= tileCount) {
+               break;
+            }
+
+            if (tileDone[tile]) {
+               continue;
+            }
+
+            int tileY = tile / tilesAcross;
+
+            traceTile((tile % tilesAcross) * tileSize, tileY * tileSize,
+             image);
+
+            if (ckptFd >= 0) {
+               writeCheckpointTile(ckptFd, tile, image);
+            }
+
+            int rowDone;
+
+            #pragma omp atomic capture
+            rowDone = ++rowTilesDone[tileY];
+
+            if (rowDone == tilesAcross) {
+               double writeStart = omp_get_wtime();
+
+               image.WriteTgaRows(outFd, tileY * tileSize,
+                min(tileY * tileSize + tileSize, height));
+
+               #pragma omp atomic
+               renderStats.writeSeconds += omp_get_wtime() - writeStart;
+            }
+
+            #pragma omp atomic
+            tilesCompleted++;
+         }
+      }
+   }
+
+   close(outFd);
+
+   // The render finished, so the checkpoint has served its purpose.
+   if (ckptFd >= 0) {
+      close(ckptFd);
+      unlink(checkpointFile.c_str());
+   }
+
+   renderStats.renderSeconds = omp_get_wtime() - renderStart;
+
+   if (!quiet) {
+      cout << "\rDone!" << endl;
+   }
+
+   cout << "Rays cast: " << renderStats.totalRays() << endl;
+   renderStats.report(cout);
+
+   if (costHeatmap) {
+      writeCostHeatmap(fileName + ".heat.tga");
+   }
+}
+
+/**
+ * Out-of-core rendering for frames larger than memory: the working buffer
+ * is one tile row high and gets rewound for each band, so peak framebuffer
+ * memory is width * tileSize Colors no matter how tall the frame is. Bands
+ * go out in order through positional writes; within a band the tiles fan
+ * out across threads. Checkpointing and the cost heatmap both need the
+ * whole frame resident, so this mode skips them.
+ */
+void RayTracer::traceBanded(string fileName) {
+   camera.calculateWUV();
+   Image band(width, tileSize);
+   band.gamma(gamma);
+
+   // Reset depthComplexity to avoid unnecessary loops.
+   if (dispersion < 0) {
+      depthComplexity = 1;
+   }
+
+   selectPixelKernel();
+   imageScale = camera.screenWidth / (float)width;
+
+   occluderCache.assign(omp_get_max_threads(),
+    vector<Object*>(lights.size(), (Object*)NULL));
+
+   int tilesAcross = (width + tileSize - 1) / tileSize;
+   int tilesDown = (height + tileSize - 1) / tileSize;
+
+   int outFd = band.OpenTgaStream(fileName.c_str(), height);
+   double renderStart = omp_get_wtime();
+
+   for (int tileY = 0; tileY < tilesDown; tileY++) {
+      band.yOffset(tileY * tileSize);
+
+      #pragma omp parallel for schedule(dynamic)
+      for (int tileX = 0; tileX < tilesAcross; tileX++) {
+         traceTile(tileX * tileSize, tileY * tileSize, band);
+      }
+
+      double writeStart = omp_get_wtime();
+
+      band.WriteTgaRows(outFd, tileY * tileSize,
+       min(tileY * tileSize + tileSize, height));
+
+      renderStats.writeSeconds += omp_get_wtime() - writeStart;
+
+      // Update percent complete. Bands finish serially, so this stays out
+      // of the render threads' way.
+      if (!quiet) {
+         float percentage = (tileY + 1)/(float)tilesDown * 100;
+         cout << '\r' << (int)percentage << '%';
+         fflush(stdout);
+      }
+   }
+
+   close(outFd);
+
+   renderStats.renderSeconds = omp_get_wtime() - renderStart;
+
+   if (!quiet) {
+      cout << "\rDone!" << endl;
+   }
+
+   cout << "Rays cast: " << renderStats.totalRays() << endl;
+   renderStats.report(cout);
+}
+
+// Distributed tile rendering: a coordinator hands out tile ranges over TCP
+// and workers running the same scene stream back shaded tiles as raw Color
+// rows. The farm must be architecture-homogeneous; sizeof(Color) is baked
+// into the handshake magic so mismatched precision builds are rejected.
+#define NET_MAGIC (0x4e545452 + (unsigned int)sizeof(Color))
+
+static bool readFully(int fd, void* buffer, size_t size) {
+   char* at = (char*)buffer;
+
+   while (size > 0) {
+      ssize_t got = read(fd, at, size);
+
+      if (got <= 0) {
+         return false;
+      }
+
+      at += got;
+      size -= got;
+   }
+
+   return true;
+}
+
+static bool writeFully(int fd, const void* buffer, size_t size) {
+   const char* at = (const char*)buffer;
+
+   while (size > 0) {
+      ssize_t put = write(fd, at, size);
+
+      if (put <= 0) {
+         return false;
+      }
+
+      at += put;
+      size -= put;
+   }
+
+   return true;
+}
+
+// A connected worker and the tile range it is currently shading.
+class WorkerLink {
+public:
+   int fd;
+   unsigned int threads;
+   int first;
+   int count;
+};
+
+/**
+ * Sends a worker its next tile range: a lost worker's requeued range if
+ * one is pending, otherwise a fresh chunk sized to roughly two tiles per
+ * worker thread so fast and slow nodes balance out. count 0 means done.
+ */
+static void assignRange(WorkerLink& link, int& nextTile, int tileCount,
+ std::vector<int>& requeuedFirst, std::vector<int>& requeuedCount) {
+   if (!requeuedFirst.empty()) {
+      link.first = requeuedFirst.back();
+      link.count = requeuedCount.back();
+      requeuedFirst.pop_back();
+      requeuedCount.pop_back();
+   } else {
+      int chunk = (int)link.threads * 2;
+
+      if (chunk < 1) {
+         chunk = 1;
+      }
+
+      if (chunk > tileCount - nextTile) {
+         chunk = tileCount - nextTile;
+      }
+
+      link.first = nextTile;
+      link.count = chunk;
+      nextTile += chunk;
+   }
+
+   int header[2] = { link.first, link.count };
+   writeFully(link.fd, header, sizeof(header));
+}
+
+/**
+ * Coordinator side of distributed rendering: listens on the given port,
+ * hands out tile ranges to however many workers connect, assembles the
+ * tiles they stream back into the final image, and requeues the range of
+ * any worker that drops (so preempted nodes only cost their in-flight
+ * tiles).
+ */
+void RayTracer::serveTiles(int port, string fileName) {
+   Image image(width, height);
+   image.gamma(gamma);
+
+   int tilesAcross = (width + tileSize - 1) / tileSize;
+   int tilesDown = (height + tileSize - 1) / tileSize;
+   int tileCount = tilesAcross * tilesDown;
+   int nextTile = 0;
+   int tilesAssembled = 0;
+
+   int listenFd = socket(AF_INET, SOCK_STREAM, 0);
+
+   if (listenFd < 0) {
+      cerr << "Failed creating socket" << endl;
+      exit(EXIT_FAILURE);
+   }
+
+   int one = 1;
+   setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+   sockaddr_in address;
+   memset(&address, 0, sizeof(address));
+   address.sin_family = AF_INET;
+   address.sin_addr.s_addr = INADDR_ANY;
+   address.sin_port = htons(port);
+
+   if (bind(listenFd, (sockaddr*)&address, sizeof(address)) < 0 ||
+    listen(listenFd, 16) < 0) {
+      cerr << "Failed binding port " << port << endl;
+      exit(EXIT_FAILURE);
+   }
+
+   cout << "Serving " << tileCount << " tiles on port " << port << endl;
+
+   vector<WorkerLink> workers;
+   vector<int> requeuedFirst;
+   vector<int> requeuedCount;
+   double renderStart = omp_get_wtime();
+
+   while (tilesAssembled < tileCount) {
+      vector<pollfd> fds(workers.size() + 1);
+
+      fds[0].fd = listenFd;
+      fds[0].events = POLLIN;
+
+      for (size_t i = 0; i < workers.size(); i++) {
+         fds[i + 1].fd = workers[i].fd;
+         fds[i + 1].events = POLLIN;
+      }
+
+      if (poll(&fds[0], fds.size(), -1) < 0) {
+         continue;
+      }
+
+      if (fds[0].revents & POLLIN) {
+         int fd = accept(listenFd, NULL, NULL);
+
+         if (fd >= 0) {
+            unsigned int hello[5];
+
+            if (readFully(fd, hello, sizeof(hello)) &&
+             hello[0] == NET_MAGIC && hello[1] == (unsigned int)width &&
+             hello[2] == (unsigned int)height &&
+             hello[3] == (unsigned int)tileSize) {
+               WorkerLink link;
+               link.fd = fd;
+               link.threads = hello[4];
+
+               assignRange(link, nextTile, tileCount, requeuedFirst,
+                requeuedCount);
+               workers.push_back(link);
+               cout << "Worker joined (" << hello[4] << " threads)" << endl;
+            } else {
+               cerr << "Rejected worker with mismatched scene setup" << endl;
+               close(fd);
+            }
+         }
+      }
+
+      for (size_t i = 0; i < workers.size(); i++) {
+         if (!(fds[i + 1].revents & (POLLIN | POLLHUP | POLLERR))) {
+            continue;
+         }
+
+         WorkerLink& link = workers[i];
+         int header[2];
+         bool ok = readFully(link.fd, header, sizeof(header)) &&
+          header[0] == link.first && header[1] == link.count;
+
+         if (ok) {
+            vector<Color> row(tileSize);
+
+            for (int tile = link.first;
+             ok && tile < link.first + link.count; tile++) {
+               int startX = (tile % tilesAcross) * tileSize;
+               int startY = (tile / tilesAcross) * tileSize;
+               int endX = min(startX + tileSize, width);
+               int endY = min(startY + tileSize, height);
+
+               for (int y = startY; ok && y < endY; y++) {
+                  ok = readFully(link.fd, &row[0],
+                   (endX - startX) * sizeof(Color));
+
+                  for (int x = startX; ok && x < endX; x++) {
+                     image.pixel(x, y, row[x - startX]);
+                  }
+               }
+            }
+         }
+
+         if (!ok) {
+            // Worker lost mid-range: put its tiles back in play.
+            cerr << endl << "Worker dropped - requeued " << link.count <<
+             " tiles" << endl;
+
+            if (link.count > 0) {
+               requeuedFirst.push_back(link.first);
+               requeuedCount.push_back(link.count);
+            }
+
+            close(link.fd);
+            workers.erase(workers.begin() + i);
+            break;
+         }
+
+         tilesAssembled += link.count;
+         assignRange(link, nextTile, tileCount, requeuedFirst,
+          requeuedCount);
+
+         if (!quiet) {
+            float percentage = tilesAssembled / (float)tileCount * 100;
+            cout << '\r' << (int)percentage << '%';
+            fflush(stdout);
+         }
+
+         // fds no longer lines up if assignments changed; repoll.
+         break;
+      }
+   }
+
+   for (size_t i = 0; i < workers.size(); i++) {
+      int done[2] = { 0, 0 };
+
+      writeFully(workers[i].fd, done, sizeof(done));
+      close(workers[i].fd);
+   }
+
+   close(listenFd);
+   renderStats.renderSeconds = omp_get_wtime() - renderStart;
+
+   if (!quiet) {
+      cout << "\rDone!" << endl;
+   }
+
+   cout << "time.render=" << renderStats.renderSeconds << endl;
+   image.WriteTga(fileName.c_str(), false);
+}
+
+/**
+ * Worker side of distributed rendering: connects to the coordinator,
+ * renders each assigned tile range with the usual OpenMP tile loop, and
+ * streams the shaded tiles back until the coordinator says done.
+ */
+void RayTracer::workTiles(string host, int port) {
+   camera.calculateWUV();
+
+   if (dispersion < 0) {
+      depthComplexity = 1;
+   }
+
+   selectPixelKernel();
+   imageScale = camera.screenWidth / (float)width;
+
+   occluderCache.assign(omp_get_max_threads(),
+    vector<Object*>(lights.size(), (Object*)NULL));
+
+   hostent* server = gethostbyname(host.c_str());
+
+   if (server == NULL) {
+      cerr << "Failed resolving host: " << host << endl;
+      exit(EXIT_FAILURE);
+   }
+
+   int fd = socket(AF_INET, SOCK_STREAM, 0);
+   sockaddr_in address;
+
+   memset(&address, 0, sizeof(address));
+   address.sin_family = AF_INET;
+   memcpy(&address.sin_addr.s_addr, server->h_addr, server->h_length);
+   address.sin_port = htons(port);
+
+   if (fd < 0 || connect(fd, (sockaddr*)&address, sizeof(address)) < 0) {
+      cerr << "Failed connecting to " << host << ":" << port << endl;
+      exit(EXIT_FAILURE);
+   }
+
+   unsigned int hello[5] = { NET_MAGIC, (unsigned int)width,
+    (unsigned int)height, (unsigned int)tileSize,
+    (unsigned int)omp_get_max_threads() };
+   writeFully(fd, hello, sizeof(hello));
+
+   Image image(width, height);
+   int tilesAcross = (width + tileSize - 1) / tileSize;
+   int rendered = 0;
+
+   for (;;) {
+      int range[2];
+
+      if (!readFully(fd, range, sizeof(range)) || range[1] == 0) {
+         break;
+      }
+
+      #pragma omp parallel for schedule(dynamic)
+      for (int tile = range[0]; tile < range[0] + range[1]; tile++) {
+         traceTile((tile % tilesAcross) * tileSize,
+          (tile / tilesAcross) * tileSize, image);
+      }
+
+      // Echo the range header back, then the raw tile rows in order.
+      writeFully(fd, range, sizeof(range));
+
+      vector<Color> row(tileSize);
+
+      for (int tile = range[0]; tile < range[0] + range[1]; tile++) {
+         int startX = (tile % tilesAcross) * tileSize;
+         int startY = (tile / tilesAcross) * tileSize;
+         int endX = min(startX + tileSize, width);
+         int endY = min(startY + tileSize, height);
+
+         for (int y = startY; y < endY; y++) {
+            for (int x = startX; x < endX; x++) {
+               row[x - startX] = image.pixel(x, y);
+            }
+
+            writeFully(fd, &row[0], (endX - startX) * sizeof(Color));
+         }
+      }
+
+      rendered += range[1];
+
+      if (!quiet) {
+         cout << '\r' << rendered << " tiles";
+         fflush(stdout);
+      }
+   }
+
+   close(fd);
+
+   if (!quiet) {
+      cout << "\rDone! (" << rendered << " tiles)" << endl;
+   }
+
+   cout << "Rays cast: " << renderStats.totalRays() << endl;
+}
+
+/**
+ * Validates the checkpoint header against this render's dimensions and
+ * loads the done bitmap plus the pixels of every finished tile. Returns
+ * false (leaving the caller to start fresh) on any mismatch or short read.
+ */
+bool RayTracer::readCheckpoint(int fd, vector<unsigned char>& tileDone,
+ Image& image) {
+   unsigned int header[4];
+
+   if (pread(fd, header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+    header[0] != CHECKPOINT_MAGIC || header[1] != (unsigned int)width ||
+    header[2] != (unsigned int)height || header[3] != (unsigned int)tileSize) {
+      return false;
+   }
+
+   if (pread(fd, &tileDone[0], tileDone.size(), sizeof(header)) !=
+    (ssize_t)tileDone.size()) {
+      return false;
+   }
+
+   int tilesAcross = (width + tileSize - 1) / tileSize;
+   off_t pixelBase = sizeof(header) + (off_t)tileDone.size();
+   vector<Color> row(tileSize);
+
+   for (int tile = 0; tile < (int)tileDone.size(); tile++) {
+      if (!tileDone[tile]) {
+         continue;
+      }
+
+      int startX = (tile % tilesAcross) * tileSize;
+      int startY = (tile / tilesAcross) * tileSize;
+      int endX = min(startX + tileSize, width);
+      int endY = min(startY + tileSize, height);
+
+      for (int y = startY; y < endY; y++) {
+         off_t offset = pixelBase +
+          ((off_t)y * width + startX) * sizeof(Color);
+         ssize_t size = (endX - startX) * sizeof(Color);
+
+         if (pread(fd, &row[0], size, offset) != size) {
+            return false;
+         }
+
+         for (int x = startX; x < endX; x++) {
+            image.pixel(x, y, row[x - startX]);
+         }
+      }
+   }
+
+   return true;
+}
+
+/**
+ * Flushes one finished tile's pixels to the checkpoint, then flips its
+ * done bit. The pixels land before the bit, so a flagged tile is always
+ * fully on disk no matter where a preemption cuts the render off.
+ */
+void RayTracer::writeCheckpointTile(int fd, int tile, Image& image) {
+   int tilesAcross = (width + tileSize - 1) / tileSize;
+   int tilesDown = (height + tileSize - 1) / tileSize;
+   off_t pixelBase = 4 * sizeof(unsigned int) +
+    (off_t)tilesAcross * tilesDown;
+
+   int startX = (tile % tilesAcross) * tileSize;
+   int startY = (tile / tilesAcross) * tileSize;
+   int endX = min(startX + tileSize, width);
+   int endY = min(startY + tileSize, height);
+
+   vector<Color> row(tileSize);
+
+   for (int y = startY; y < endY; y++) {
+      for (int x = startX; x < endX; x++) {
+         row[x - startX] = image.pixel(x, y);
+      }
+
+      pwrite(fd, &row[0], (endX - startX) * sizeof(Color),
+       pixelBase + ((off_t)y * width + startX) * sizeof(Color));
+   }
+
+   unsigned char done = 1;
+   pwrite(fd, &done, 1, 4 * sizeof(unsigned int) + tile);
+}
+
+/**
+ * Cold blue through green to hot red for a normalized cost.
+ */
+static Color heatColor(double t) {
+   if (t < 0.5) {
+      return Color(0.0, 2.0 * t, 1.0 - 2.0 * t);
+   }
+
+   return Color(2.0 * t - 1.0, 2.0 - 2.0 * t, 0.0);
+}
+
+void RayTracer::writeCostHeatmap(string fileName) {
+   double maxCost = 0.0;
+
+   for (size_t i = 0; i < pixelCost.size(); i++) {
+      maxCost = max(maxCost, pixelCost[i]);
+   }
+
+   Image heat(width, height);
+
+   for (int y = 0; y < height; y++) {
+      for (int x = 0; x < width; x++) {
+         double t = maxCost > 0.0 ? pixelCost[y * width + x] / maxCost : 0.0;
+
+         heat.pixel(x, y, heatColor(t));
+      }
+   }
+
+   heat.WriteTga(fileName.c_str(), false);
+   cout << "Wrote cost heatmap: " << fileName <<
+    " (max " << (unsigned long long)maxCost << " node+object tests/pixel)" << endl;
+}
+
+/**
+ * De-interleaves the even bits of a Morton code into one axis value.
+ */
+static int compactBits(unsigned int code) {
+   code &= 0x55555555;
+   code = (code | (code >> 1)) & 0x33333333;
+   code = (code | (code >> 2)) & 0x0f0f0f0f;
+   code = (code | (code >> 4)) & 0x00ff00ff;
+   code = (code | (code >> 8)) & 0x0000ffff;
+   return (int)code;
+}
+
+void RayTracer::traceTile(int startX, int startY, Image& image) {
+   // The wavefront engine replaces the recursive per-pixel path wholesale
+   // (except for the cost heatmap, whose per-pixel accounting needs the
+   // recursive structure).
+   if (wavefront && !costHeatmap) {
+      traceTileWavefront(startX, startY, image);
+      return;
+   }
+
+   // Shared-lattice supersampling also owns the whole tile. It needs the
+   // boundary samples of neighboring pixels to coincide, which the
+   // dispersion loop breaks (lens samples differ per pixel), so it only
+   // engages without depth of field.
+   if (sharedSamples && depthComplexity == 1 && !costHeatmap) {
+      traceTileLattice(startX, startY, image);
+      return;
+   }
+
+   int endX = min(startX + tileSize, width);
+   int endY = min(startY + tileSize, height);
+
+   // Walk the tile in Morton (Z) order so rays traced close in time start
+   // close in space: their BSP traversals share nodes and geometry cache
+   // lines, which matters once reflections make ray trees deep. Pixel
+   // values are order-independent (each pixel owns its sampler), so this
+   // is purely a cache win.
+   int side = 1;
+
+   while (side < tileSize) {
+      side <<= 1;
+   }
+
+   for (int code = 0; code < side * side; code++) {
+      int x = startX + compactBits((unsigned int)code);
+      int y = startY + compactBits((unsigned int)code >> 1);
+
+      if (x >= endX || y >= endY) {
+         continue;
+      }
+
+      if (costHeatmap) {
+         // Traversal work (nodes visited plus primitive tests) charged
+         // to this pixel, measured as the delta on this thread's
+         // counters around the pixel's rays.
+         RenderStats::Counters& local = renderStats.local();
+         unsigned long long before = local.nodesVisited + local.objectTests;
+
+         image.pixel(x, y, (this->*pixelKernel)(x, y));
+
+         pixelCost[y * width + x] =
+          (double)(local.nodesVisited + local.objectTests - before);
+      } else {
+         image.pixel(x, y, (this->*pixelKernel)(x, y));
+      }
+   }
+}
+
+/**
+ * Progressive preview: every pass shoots one low-discrepancy sample per
+ * pixel across the whole frame, accumulates into a float buffer, and
+ * rewrites the output image, so a usable preview appears after the first
+ * pass and keeps refining until the sample budget (the same
+ * superSamples^2 * depthComplexity rays the offline path would spend) is
+ * reached or the process is killed.
+ */
+void RayTracer::traceProgressive(string fileName) {
+   camera.calculateWUV();
+
+   if (dispersion < 0) {
+      depthComplexity = 1;
+   }
+
+   imageScale = camera.screenWidth / (float)width;
+
+   occluderCache.assign(omp_get_max_threads(),
+    vector<Object*>(lights.size(), (Object*)NULL));
+
+   int passes = superSamples * superSamples * depthComplexity;
+   vector<Color> accumulated((size_t)width * height);
+   Image image(width, height);
+   image.gamma(gamma);
+   double renderStart = omp_get_wtime();
+
+   for (int pass = 0; pass < passes; pass++) {
+      #pragma omp parallel for schedule(dynamic, 4)
+      for (int y = 0; y < height; y++) {
+         for (int x = 0; x < width; x++) {
+            accumulated[y * width + x] = accumulated[y * width + x] +
+             castProgressiveSample(x, y, pass, passes);
+         }
+      }
+
+      double weight = 1.0 / (pass + 1);
+
+      for (int y = 0; y < height; y++) {
+         for (int x = 0; x < width; x++) {
+            image.pixel(x, y, accumulated[y * width + x] * weight);
+         }
+      }
+
+      image.WriteTga(fileName.c_str(), false);
+
+      if (!quiet) {
+         cout << "Pass " << (pass + 1) << "/" << passes << " (" <<
+          (omp_get_wtime() - renderStart) << "s)" << endl;
+      }
+   }
+
+   renderStats.renderSeconds = omp_get_wtime() - renderStart;
+
+   if (!quiet) {
+      cout << "Done!" << endl;
+   }
+
+   cout << "Rays cast: " << renderStats.totalRays() << endl;
+   renderStats.report(cout);
+}
+
+/**
+ * One jittered primary ray for a progressive pass. The pass index rides
+ * the seed's high bits, so every (pixel, pass) pair draws an independent
+ * deterministic sequence and reruns stay reproducible.
+ */
+Color RayTracer::castProgressiveSample(int x, int y, int pass, int passes) {
+   Sampler sampler(((unsigned long long)y * width + x) |
+    ((unsigned long long)(pass + 1) << 32));
+
+   double rayX = (x - width / 2) / 2.0;
+   double rayY = (y - height / 2) / 2.0;
+   double pixelWidth = rayX - (x + 1 - width / 2) / 2.0;
+
+   double u, v;
+   sampler.squareSample(pass, passes, u, v);
+
+   Vector imagePlanePoint = camera.lookAt -
+    (camera.u * (rayX - pixelWidth / 2.0 + u * pixelWidth) * imageScale) +
+    (camera.v * (rayY - pixelWidth / 2.0 + v * pixelWidth) * imageScale);
+
+   renderStats.local().primaryRays++;
+
+   Ray viewRay(camera.position, imagePlanePoint - camera.position,
+    maxReflections, startingMaterial);
+
+   viewRay.sampler = &sampler;
+
+   if (depthComplexity > 1) {
+      // One lens sample per pass; the disk matches the offline path's.
+      double lensU, lensV, lensX, lensY;
+      sampler.squareSample(pass, passes, lensU, lensV);
+      Sampler::toDisk(lensU, lensV, lensX, lensY);
+
+      Vector disturbance(
+       dispersion * 0.5 * lensX,
+       dispersion * 0.5 * lensY,
+       0.0f);
+
+      viewRay.origin = viewRay.origin + disturbance;
+      viewRay.direction = imagePlanePoint - viewRay.origin;
+      viewRay.direction = viewRay.direction.normalize();
    }
 
-   delete startingMaterial;
+   return castRay(viewRay);
 }
 
-void RayTracer::traceRays(string fileName) {
-   int columnsCompleted = 0;
-   camera.calculateWUV();
-   Image image(width, height);
+// A ray queued in the wavefront engine: the tile pixel it feeds and the
+// scalar weight its shading result contributes there.
+class WaveRay {
+public:
+   Ray ray;
+   int pixel;
+   double weight;
+};
 
-   // Reset depthComplexity to avoid unnecessary loops.
-   if (dispersion < 0) {
-      depthComplexity = 1;
+// Material-type comparison for shading-order sorts; ties keep queue order.
+class WaveHitOrder {
+public:
+   const std::vector<Intersection>& hits;
+
+   WaveHitOrder(const std::vector<Intersection>& hits_) : hits(hits_) {}
+
+   bool operator () (int a, int b) const {
+      return hits[a].endMaterial->type < hits[b].endMaterial->type;
    }
+};
 
-   imageScale = camera.screenWidth / (float)width;
+/**
+ * Wavefront engine: instead of recursing per ray, the tile's primary rays
+ * are queued, each wave is traversed back to back, and the hits are shaded
+ * in material-sorted batches (texture lookups go through the materials'
+ * batched getColors hook), with reflection/refraction children enqueued
+ * for the next wave. Shadow rays stay inline in the shading stage because
+ * the light loop's multiplicative accumulation needs every light's
+ * occlusion before it can combine them. Enabled by the wavefront scene
+ * keyword; the adaptive and 2x2-packet fast paths don't apply here, every
+ * pixel shoots its full sample grid.
+ */
+void RayTracer::traceTileWavefront(int startX, int startY, Image& image) {
+   int endX = min(startX + tileSize, width);
+   int endY = min(startY + tileSize, height);
+   int tileW = endX - startX;
+
+   vector<Color> pixelColors(tileW * (endY - startY));
+   vector<Sampler> samplers;
+   samplers.reserve(pixelColors.size());
+
+   vector<WaveRay> wave;
+
+   // Same image-plane math as the recursive path, one queue entry per
+   // sample (times depthComplexity lens samples when depth of field is
+   // on).
+   for (int y = startY; y < endY; y++) {
+      for (int x = startX; x < endX; x++) {
+         samplers.push_back(Sampler((unsigned long long)y * width + x));
+
+         Sampler& sampler = samplers.back();
+         int pixel = (y - startY) * tileW + (x - startX);
+
+         double rayX = (x - width / 2) / 2.0;
+         double rayY = (y - height / 2) / 2.0;
+         double pixelWidth = rayX - (x + 1 - width / 2) / 2.0;
+         double sampleWidth = pixelWidth / superSamples;
+         double sampleStartX = rayX - pixelWidth / 2.0;
+         double sampleStartY = rayY - pixelWidth / 2.0;
+         double sampleWeight = 1.0 / (superSamples * superSamples);
+
+         for (int sx = 0; sx < superSamples; sx++) {
+            for (int sy = 0; sy < superSamples; sy++) {
+               Vector imagePlanePoint = camera.lookAt -
+                (camera.u * (sampleStartX + (sx * sampleWidth)) * imageScale) +
+                (camera.v * (sampleStartY + (sy * sampleWidth)) * imageScale);
+
+               for (int i = 0; i < depthComplexity; i++) {
+                  renderStats.local().primaryRays++;
+
+                  WaveRay entry;
+                  entry.ray = Ray(camera.position,
+                   imagePlanePoint - camera.position, maxReflections,
+                   startingMaterial);
+                  entry.ray.sampler = &sampler;
+                  entry.pixel = pixel;
+                  entry.weight = sampleWeight * (1 / (float)depthComplexity);
+
+                  if (depthComplexity > 1) {
+                     double u, v, lensX, lensY;
+                     sampler.squareSample(i, depthComplexity, u, v);
+                     Sampler::toDisk(u, v, lensX, lensY);
+
+                     Vector disturbance(
+                      dispersion * 0.5 * lensX,
+                      dispersion * 0.5 * lensY,
+                      0.0f);
+
+                     entry.ray.origin = entry.ray.origin + disturbance;
+                     entry.ray.direction = imagePlanePoint - entry.ray.origin;
+                     entry.ray.direction = entry.ray.direction.normalize();
+                  }
+
+                  wave.push_back(entry);
+               }
+            }
+         }
+      }
+   }
 
-   #pragma omp parallel for
-   for (int x = 0; x < width; x++) {
-      // Update percent complete.
-      columnsCompleted++;
-      float percentage = columnsCompleted/(float)width * 100;
-      cout << '\r' << (int)percentage << '%';
-      fflush(stdout);
+   vector<WaveRay> next;
+   vector<Intersection> hits;
+   vector<int> order;
+   vector<Vector> points;
+   vector<Color> colors;
 
-      for (int y = 0; y < height; y++) {
-         image.pixel(x, y, castRayForPixel(x, y));
+   while (!wave.empty()) {
+      // Stage 1: traverse the whole wave back to back, no shading mixed
+      // in.
+      hits.resize(wave.size());
+
+      for (size_t i = 0; i < wave.size(); i++) {
+         hits[i] = getClosestIntersection(wave[i].ray);
+      }
+
+      // Stage 2: order the hits by material type so shading runs each
+      // material's code (and its texture evaluation) in long runs.
+      order.clear();
+
+      for (size_t i = 0; i < wave.size(); i++) {
+         if (hits[i].didIntersect) {
+            order.push_back((int)i);
+         }
+      }
+
+      stable_sort(order.begin(), order.end(), WaveHitOrder(hits));
+
+      // Stage 3: shade material run by material run, queueing children.
+      next.clear();
+
+      size_t at = 0;
+
+      while (at < order.size()) {
+         Material* material = hits[order[at]].endMaterial;
+         size_t runEnd = at;
+
+         while (runEnd < order.size() &&
+          hits[order[runEnd]].endMaterial == material) {
+            runEnd++;
+         }
+
+         points.resize(runEnd - at);
+         colors.resize(runEnd - at);
+
+         for (size_t i = at; i < runEnd; i++) {
+            points[i - at] = hits[order[i]].intersection;
+         }
+
+         material->getColors(&points[0], (int)points.size(), &colors[0]);
+
+         for (size_t i = at; i < runEnd; i++) {
+            const Intersection& hit = hits[order[i]];
+            const WaveRay& source = wave[order[i]];
+            const Color& color = colors[i - at];
+
+            Color shaded = getAmbientLighting(hit, color) +
+             getDiffuseAndSpecularLighting(hit, color);
+
+            pixelColors[source.pixel] = pixelColors[source.pixel] +
+             (shaded * source.weight);
+
+            Ray children[2];
+            double weights[2];
+            int childCount = makeSecondaryRays(hit, children, weights);
+
+            for (int child = 0; child < childCount; child++) {
+               WaveRay entry;
+
+               entry.ray = children[child];
+               entry.pixel = source.pixel;
+               entry.weight = source.weight * weights[child];
+               next.push_back(entry);
+            }
+         }
+
+         at = runEnd;
       }
+
+      wave.swap(next);
    }
 
-   cout << "\rDone!" << endl;
-   cout << "Rays cast: " << raysCast << endl;
+   for (int y = startY; y < endY; y++) {
+      for (int x = startX; x < endX; x++) {
+         image.pixel(x, y, pixelColors[(y - startY) * tileW + (x - startX)]);
+      }
+   }
+}
 
-   image.WriteTga(fileName.c_str(), false);
+/**
+ * Shared-lattice supersampling. The pixel kernels place a
+ * pixel's boundary samples at the same image-plane points as its
+ * neighbors', yet every pixel recomputes them. Here the tile shoots one
+ * (tileW * S + 1) x (tileH * S + 1) lattice of corner samples and each
+ * pixel averages its (S + 1)^2 window of it, so boundary lattice points
+ * serve adjacent pixels instead of being recomputed. The payoff is at
+ * S = 1: each pixel integrates its four shared corners for roughly 1
+ * primary ray per pixel, versus 4 for an independent 2x2 grid of
+ * comparable filter quality. Lattice points are seeded from their global
+ * lattice coordinates, so results stay independent of tile layout.
+ */
+void RayTracer::traceTileLattice(int startX, int startY, Image& image) {
+   int endX = min(startX + tileSize, width);
+   int endY = min(startY + tileSize, height);
+   int latticeWidth = (endX - startX) * superSamples + 1;
+   int latticeHeight = (endY - startY) * superSamples + 1;
+
+   double rayX = (startX - width / 2)/2.0;
+   double rayY = (startY - height / 2)/2.0;
+   double pixelWidth = rayX - (startX + 1 - width / 2)/2.0;
+   double sampleWidth = pixelWidth / superSamples;
+   double sampleStartX = rayX - pixelWidth/2.0;
+   double sampleStartY = rayY - pixelWidth/2.0;
+
+   vector<Color> lattice((size_t)latticeWidth * latticeHeight);
+   unsigned long long latticeSpan =
+    (unsigned long long)width * superSamples + 1;
+
+   for (int ly = 0; ly < latticeHeight; ly++) {
+      for (int lx = 0; lx < latticeWidth; lx++) {
+         Sampler sampler(
+          ((unsigned long long)startY * superSamples + ly) * latticeSpan +
+          (unsigned long long)startX * superSamples + lx);
+
+         Vector imagePlanePoint = camera.lookAt -
+          (camera.u * (sampleStartX + (lx * sampleWidth)) * imageScale) +
+          (camera.v * (sampleStartY + (ly * sampleWidth)) * imageScale);
+
+         lattice[ly * latticeWidth + lx] =
+          castRayAtPointKernel<false>(imagePlanePoint, sampler);
+      }
+   }
+
+   double weight = 1.0 / ((superSamples + 1) * (superSamples + 1));
+
+   for (int y = startY; y < endY; y++) {
+      for (int x = startX; x < endX; x++) {
+         Color color;
+
+         for (int sy = 0; sy <= superSamples; sy++) {
+            for (int sx = 0; sx <= superSamples; sx++) {
+               int lx = (x - startX) * superSamples + sx;
+               int ly = (y - startY) * superSamples + sy;
+
+               color = color + (lattice[ly * latticeWidth + lx] * weight);
+            }
+         }
+
+         image.pixel(x, y, color);
+      }
+   }
 }
 
-Color RayTracer::castRayForPixel(int x, int y) {
+/**
+ * Per-pixel render kernel. SS > 0 bakes the supersample count into the
+ * instantiation so the sample loops have constant trip counts; SS == 0
+ * reads the runtime setting and serves every preset the dispatch doesn't
+ * specialize. DOF mirrors depthComplexity > 1 the same way, letting the
+ * no-lens instantiations drop the whole dispersion path at compile time.
+ */
+template <int SS, bool DOF>
+Color RayTracer::castRayForPixelKernel(int x, int y) {
+   const int samples = SS > 0 ? SS : superSamples;
    double rayX = (x - width / 2)/2.0;
    double rayY = (y - height / 2)/2.0;
    double pixelWidth = rayX - (x + 1 - width / 2)/2.0;
-   double sampleWidth = pixelWidth / superSamples;
+   double sampleWidth = pixelWidth / samples;
    double sampleStartX = rayX - pixelWidth/2.0;
    double sampleStartY = rayY - pixelWidth/2.0;
-   double sampleWeight = 1.0 / (superSamples * superSamples);
+   double sampleWeight = 1.0 / (samples * samples);
    Color color;
 
-   for (int x = 0; x < superSamples; x++) {
-      for (int y = 0; y < superSamples; y++) {
+   // Each pixel owns a deterministic sampler seeded from its coordinates,
+   // so results are reproducible no matter how tiles land on threads.
+   Sampler sampler((unsigned long long)y * width + x);
+
+   // Coherent 2x2 supersample grids ride the packet path when depth of
+   // field is off - four primary rays share one traversal.
+   if (samples == 2 && !DOF && depthComplexity == 1) {
+      Ray rays[PACKET_SIZE];
+      Color colors[PACKET_SIZE];
+      int count = 0;
+
+      for (int sx = 0; sx < 2; sx++) {
+         for (int sy = 0; sy < 2; sy++) {
+            Vector imagePlanePoint = camera.lookAt -
+             (camera.u * (sampleStartX + (sx * sampleWidth)) * imageScale) +
+             (camera.v * (sampleStartY + (sy * sampleWidth)) * imageScale);
+
+            rays[count++] = Ray(camera.position, imagePlanePoint - camera.position,
+             maxReflections, startingMaterial);
+            rays[count - 1].sampler = &sampler;
+         }
+      }
+
+      castRayPacket(rays, count, colors);
+
+      for (int i = 0; i < count; i++) {
+         color = color + (colors[i] * sampleWeight);
+      }
+
+      return color;
+   }
+
+   // Adaptive mode: probe the four corner samples first and only shoot
+   // the full grid for pixels where they disagree. Flat regions settle
+   // for the corner average.
+   if (adaptiveThreshold > 0 && samples > 2) {
+      Color corners[4];
+      int corner = 0;
+
+      for (int sx = 0; sx < samples; sx += samples - 1) {
+         for (int sy = 0; sy < samples; sy += samples - 1) {
+            Vector imagePlanePoint = camera.lookAt -
+             (camera.u * (sampleStartX + (sx * sampleWidth)) * imageScale) +
+             (camera.v * (sampleStartY + (sy * sampleWidth)) * imageScale);
+
+            corners[corner++] = castRayAtPointKernel<DOF>(imagePlanePoint,
+             sampler);
+         }
+      }
+
+      Color mean;
+
+      for (int i = 0; i < 4; i++) {
+         mean = mean + (corners[i] * 0.25);
+      }
+
+      double variance = 0.0;
+
+      for (int i = 0; i < 4; i++) {
+         double dr = corners[i].r - mean.r;
+         double dg = corners[i].g - mean.g;
+         double db = corners[i].b - mean.b;
+
+         variance = max(variance, (dr * dr + dg * dg + db * db) / 3.0);
+      }
+
+      if (variance <= adaptiveThreshold) {
+         return mean;
+      }
+   }
+
+   for (int x = 0; x < samples; x++) {
+      for (int y = 0; y < samples; y++) {
          Vector imagePlanePoint = camera.lookAt -
           (camera.u * (sampleStartX + (x * sampleWidth)) * imageScale) +
           (camera.v * (sampleStartY + (y * sampleWidth)) * imageScale);
 
-         color = color + (castRayAtPoint(imagePlanePoint) * sampleWeight);
+         color = color + (castRayAtPointKernel<DOF>(imagePlanePoint,
+          sampler) * sampleWeight);
       }
    }
 
    return color;
 }
 
-Color RayTracer::castRayAtPoint(const Vector& point) {
-   Color color;
+/**
+ * Binds pixelKernel to the instantiation matching this render's preset.
+ * superSamples 1, 2 and 4 are the configurations the farm actually runs;
+ * the 1-sample no-lens pair in particular compiles down to a single
+ * unconditional primary ray per pixel. Everything else lands on the
+ * runtime-count instantiation, which behaves exactly like the old
+ * castRayForPixel.
+ */
+void RayTracer::selectPixelKernel() {
+   bool dof = depthComplexity > 1;
+
+   if (superSamples == 1) {
+      pixelKernel = dof ? &RayTracer::castRayForPixelKernel<1, true> :
+       &RayTracer::castRayForPixelKernel<1, false>;
+   } else if (superSamples == 2) {
+      pixelKernel = dof ? &RayTracer::castRayForPixelKernel<2, true> :
+       &RayTracer::castRayForPixelKernel<2, false>;
+   } else if (superSamples == 4) {
+      pixelKernel = dof ? &RayTracer::castRayForPixelKernel<4, true> :
+       &RayTracer::castRayForPixelKernel<4, false>;
+   } else {
+      pixelKernel = dof ? &RayTracer::castRayForPixelKernel<0, true> :
+       &RayTracer::castRayForPixelKernel<0, false>;
+   }
+}
+
+template <bool DOF>
+Ray RayTracer::makeLensRay(const Vector& point, Sampler& sampler,
+ int sampleIndex) {
+   renderStats.local().primaryRays++;
 
-   for (int i = 0; i < depthComplexity; i++) {
-      Ray viewRay(camera.position, point - camera.position, maxReflections,
-       startingMaterial);
+   Ray viewRay(camera.position, point - camera.position, maxReflections,
+    startingMaterial);
 
-      if (depthComplexity > 1) {
-         Vector disturbance(
-          (dispersion / RAND_MAX) * (1.0f * rand()),
-          (dispersion / RAND_MAX) * (1.0f * rand()),
-          0.0f);
+   viewRay.sampler = &sampler;
 
-         viewRay.origin = viewRay.origin + disturbance;
-         viewRay.direction = point - viewRay.origin;
-         viewRay.direction = viewRay.direction.normalize();
+   if (DOF) {
+      // Stratified lens position on a circular aperture. The disk
+      // diameter matches the old square disturbance's extent so scene
+      // dispersion values keep their meaning.
+      double u, v, lensX, lensY;
+      sampler.squareSample(sampleIndex, depthComplexity, u, v);
+      Sampler::toDisk(u, v, lensX, lensY);
+
+      Vector disturbance(
+       dispersion * 0.5 * lensX,
+       dispersion * 0.5 * lensY,
+       0.0f);
+
+      viewRay.origin = viewRay.origin + disturbance;
+      viewRay.direction = point - viewRay.origin;
+      viewRay.direction = viewRay.direction.normalize();
+   }
+
+   return viewRay;
+}
+
+template <bool DOF>
+Color RayTracer::castRayAtPointKernel(const Vector& point, Sampler& sampler) {
+   // Convergence mode for the lens loop (dofThreshold): Welford running
+   // mean/variance of sample luminance, stopping once the variance of the
+   // mean falls below the threshold, with depthComplexity as the cap.
+   // In-focus points agree after a handful of lens samples; only bokeh
+   // regions pay for the full loop.
+   if (DOF && dofThreshold > 0) {
+      Color sum;
+      double mean = 0.0;
+      double m2 = 0.0;
+      int count = 0;
+
+      for (int i = 0; i < depthComplexity; i++) {
+         Color sample = castRay(makeLensRay<DOF>(point, sampler, i));
+
+         sum = sum + sample;
+         count++;
+
+         double luminance = (sample.r + sample.g + sample.b) / 3.0;
+         double delta = luminance - mean;
+         mean += delta / count;
+         m2 += delta * (luminance - mean);
+
+         // The estimate needs a few samples before it means anything.
+         if (count >= 4 && m2 / (count - 1) / count <= dofThreshold) {
+            break;
+         }
       }
 
-      color = color + (castRay(viewRay) * (1 / (float)depthComplexity));
+      return sum * (1.0 / count);
+   }
+
+   Color color;
+   const int lensSamples = DOF ? depthComplexity : 1;
+
+   for (int i = 0; i < lensSamples; i++) {
+      color = color + (castRay(makeLensRay<DOF>(point, sampler, i)) *
+       (1 / (float)depthComplexity));
    }
 
    return color;
 }
 
+void RayTracer::castRayPacket(const Ray rays[], int count, Color colors[]) {
+   Intersection intersections[PACKET_SIZE];
+
+   renderStats.local().primaryRays += count;
+   bsp->getClosestIntersections(rays, count, intersections);
+
+   // Shading stays scalar - secondary rays recurse through castRay.
+   for (int i = 0; i < count; i++) {
+      if (intersections[i].didIntersect) {
+         colors[i] = performLighting(intersections[i]);
+      } else {
+         colors[i] = Color();
+      }
+   }
+}
+
 Color RayTracer::castRay(const Ray& ray) {
-   raysCast++;
    Intersection intersection = getClosestIntersection(ray);
 
    if (intersection.didIntersect) {
@@ -127,10 +1538,76 @@ Color RayTracer::castRay(const Ray& ray) {
    }
 }
 
-bool RayTracer::isInShadow(const Ray& ray, double lightDistance) {
-   Intersection intersection = getClosestIntersection(ray);
+/**
+ * Fraction of an area light visible from the shading point, from a
+ * stratified batch of shadow rays at points on the light sphere. The
+ * batch shares the shading point's setup and the per-light occluder
+ * cache, so a fully blocked point usually pays one cached primitive test
+ * per sample instead of a tree walk. Samples draw from the pixel's
+ * sampler to stay deterministic; rays without one get a single ray at
+ * the light center, which degrades to a hard shadow rather than biasing.
+ */
+double RayTracer::getLightVisibility(const Intersection& intersection,
+ Light* light, int lightIndex) {
+   Sampler* sampler = intersection.ray.sampler;
+
+   if (sampler == NULL) {
+      Vector offset = light->position - intersection.intersection;
+      Ray centerRay(intersection.intersection, offset, 1,
+       intersection.ray.material);
+
+      return isInShadow(centerRay, offset.length(), lightIndex) ? 0.0 : 1.0;
+   }
+
+   int samples = max(1, light->samples);
+   int visible = 0;
+
+   for (int i = 0; i < samples; i++) {
+      double u, v;
+      sampler->squareSample(i, samples, u, v);
+
+      // Uniform point on the light sphere.
+      double z = 1.0 - 2.0 * u;
+      double ring = sqrt(max(0.0, 1.0 - z * z));
+      double phi = 2.0 * M_PI * v;
+      Vector target = light->position +
+       Vector(ring * cos(phi), ring * sin(phi), z) * light->radius;
+      Vector offset = target - intersection.intersection;
+      double distance = offset.length();
+
+      if (distance == 0.0) {
+         visible++;
+         continue;
+      }
+
+      Ray shadowRay(intersection.intersection, offset, 1,
+       intersection.ray.material);
+
+      if (!isInShadow(shadowRay, distance, lightIndex)) {
+         visible++;
+      }
+   }
 
-   return intersection.didIntersect && intersection.distance < lightDistance;
+   return visible / (double)samples;
+}
+
+bool RayTracer::isInShadow(const Ray& ray, double lightDistance, int lightIndex) {
+   renderStats.local().shadowRays++;
+
+   // Neighboring shading points almost always see the same occluder for a
+   // given light, so test this thread's last one first - a hit means zero
+   // tree traversal.
+   Object*& lastOccluder = occluderCache[omp_get_thread_num()][lightIndex];
+
+   if (lastOccluder != NULL && lastOccluder->anyIntersection(ray, lightDistance)) {
+      renderStats.local().occluderCacheHits++;
+      return true;
+   }
+
+   // Shadow rays only need a boolean so don't search for the closest hit.
+   lastOccluder = bsp->anyIntersection(ray, lightDistance);
+
+   return lastOccluder != NULL;
 }
 
 Intersection RayTracer::getClosestIntersection(const Ray& ray) {
@@ -151,18 +1628,105 @@ Color RayTracer::getAmbientLighting(const Intersection& intersection, const Colo
    return color * 0.2;
 }
 
+/**
+ * Pending point-light shadow queries for one shading point. Everything
+ * except occlusion - direction, distance, the diffuse dot and the
+ * specular term - is computed up front in the light loop and parked
+ * here, so occlusion can resolve for the whole batch at once instead of
+ * one traversal per light.
+ */
+class ShadowBatch {
+public:
+   Ray rays[PACKET_SIZE];
+   double distances[PACKET_SIZE];
+   int lightIndexes[PACKET_SIZE];
+   double dots[PACKET_SIZE];
+   Color speculars[PACKET_SIZE];
+   int count;
+
+   ShadowBatch() : count(0) {}
+};
+
+/**
+ * Resolves a batch's occlusion and folds the unblocked lights into the
+ * running sums, in light order. Rays whose per-light occluder cache
+ * entry still blocks them never reach the tree; the rest traverse as one
+ * packet, sharing the AABB tests the same way primary packets do.
+ */
+void RayTracer::flushShadowBatch(const Color& color, ShadowBatch& batch,
+ Color& diffuseColor, Color& specularColor) {
+   if (batch.count == 0) {
+      return;
+   }
+
+   bool occluded[PACKET_SIZE];
+   Ray packet[PACKET_SIZE];
+   double packetDistances[PACKET_SIZE];
+   int packetSlots[PACKET_SIZE];
+   int packetCount = 0;
+   int thread = omp_get_thread_num();
+
+   for (int i = 0; i < batch.count; i++) {
+      renderStats.local().shadowRays++;
+
+      Object*& lastOccluder = occluderCache[thread][batch.lightIndexes[i]];
+
+      if (lastOccluder != NULL &&
+       lastOccluder->anyIntersection(batch.rays[i], batch.distances[i])) {
+         renderStats.local().occluderCacheHits++;
+         occluded[i] = true;
+      } else {
+         occluded[i] = false;
+         packet[packetCount] = batch.rays[i];
+         packetDistances[packetCount] = batch.distances[i];
+         packetSlots[packetCount] = i;
+         packetCount++;
+      }
+   }
+
+   if (packetCount > 0) {
+      Object* occluders[PACKET_SIZE];
+
+      bsp->anyIntersections(packet, packetCount, packetDistances, occluders);
+
+      for (int i = 0; i < packetCount; i++) {
+         int slot = packetSlots[i];
+
+         occluderCache[thread][batch.lightIndexes[slot]] = occluders[i];
+         occluded[slot] = occluders[i] != NULL;
+      }
+   }
+
+   for (int i = 0; i < batch.count; i++) {
+      if (occluded[i]) {
+         continue;
+      }
+
+      diffuseColor = (diffuseColor + (color * batch.dots[i])) *
+       lights[batch.lightIndexes[i]]->intensity;
+      specularColor = specularColor + batch.speculars[i];
+   }
+
+   batch.count = 0;
+}
+
 Color RayTracer::getDiffuseAndSpecularLighting(const Intersection& intersection,
  const Color& color) {
    Color diffuseColor(0.0, 0.0, 0.0);
    Color specularColor(0.0, 0.0, 0.0);
+   ShadowBatch batch;
 
-   for (vector<Light*>::iterator itr = lights.begin(); itr < lights.end(); itr++) {
-      Light* light = *itr;
+   for (int lightIndex = 0; lightIndex < (int)lights.size(); lightIndex++) {
+      Light* light = lights[lightIndex];
       Vector lightOffset = light->position - intersection.intersection;
       double lightDistance = lightOffset.length();
-      /**
-       * TODO: Be careful about normalizing lightOffset too.
-       */
+
+      // A light sitting exactly on the surface point has no direction -
+      // normalizing the zero offset would seed NaNs into the sums below.
+      if (lightDistance == 0.0) {
+         continue;
+      }
+
       Vector lightDirection = lightOffset.normalize();
       double dotProduct = intersection.normal.dot(lightDirection);
 
@@ -170,22 +1734,57 @@ Color RayTracer::getDiffuseAndSpecularLighting(const Intersection& intersection,
        * Intersection is facing light.
        */
       if (dotProduct >= 0.0f) {
-         Ray shadowRay = Ray(intersection.intersection, lightDirection, 1,
-          intersection.ray.material);
+         Color specular = getSpecularLighting(intersection, light);
 
-         if (isInShadow(shadowRay, lightDistance)) {
+         if (lightCullThreshold > 0) {
             /**
-             * Position is in shadow of another object - continue with other lights.
+             * Everything except occlusion is known at this point, so a
+             * light whose unshadowed contribution is already negligible
+             * skips its shadow ray entirely.
              */
-            continue;
+            double maxChannel = max(color.r, max(color.g, color.b));
+            double potential = light->intensity * dotProduct * maxChannel +
+             max(specular.r, max(specular.g, specular.b));
+
+            if (potential < lightCullThreshold) {
+               continue;
+            }
          }
 
-         diffuseColor = (diffuseColor + (color * dotProduct)) *
-          light->intensity;
-         specularColor = specularColor + getSpecularLighting(intersection, light);
+         if (light->radius > 0) {
+            // Area lights resolve on the spot, so the batched lights
+            // ahead of this one have to land in the sums first to keep
+            // the accumulation in light order.
+            flushShadowBatch(color, batch, diffuseColor, specularColor);
+
+            double visibility = getLightVisibility(intersection, light,
+             lightIndex);
+
+            if (visibility == 0.0) {
+               continue;
+            }
+
+            diffuseColor = (diffuseColor +
+             (color * (dotProduct * visibility))) * light->intensity;
+            specularColor = specularColor + (specular * visibility);
+         } else {
+            batch.rays[batch.count] = Ray(intersection.intersection,
+             lightDirection, 1, intersection.ray.material);
+            batch.distances[batch.count] = lightDistance;
+            batch.lightIndexes[batch.count] = lightIndex;
+            batch.dots[batch.count] = dotProduct;
+            batch.speculars[batch.count] = specular;
+            batch.count++;
+
+            if (batch.count == PACKET_SIZE) {
+               flushShadowBatch(color, batch, diffuseColor, specularColor);
+            }
+         }
       }
    }
 
+   flushShadowBatch(color, batch, diffuseColor, specularColor);
+
    return diffuseColor + specularColor;
 }
 
@@ -201,6 +1800,12 @@ Color RayTracer::getSpecularLighting(const Intersection& intersection,
 
    Vector view = (intersection.ray.origin - intersection.intersection).normalize();
    Vector lightOffset = light->position - intersection.intersection;
+
+   // No meaningful highlight direction when the light sits on the point.
+   if (lightOffset.dot(lightOffset) == 0.0) {
+      return specularColor;
+   }
+
    Vector reflected = reflectVector(lightOffset.normalize(), intersection.normal);
 
    double dot = view.dot(reflected);
@@ -219,6 +1824,27 @@ Color RayTracer::getSpecularLighting(const Intersection& intersection,
 }
 
 Color RayTracer::getReflectiveRefractiveLighting(const Intersection& intersection) {
+   Ray children[2];
+   double weights[2];
+   int count = makeSecondaryRays(intersection, children, weights);
+   Color color;
+
+   for (int i = 0; i < count; i++) {
+      color = color + (castRay(children[i]) * weights[i]);
+   }
+
+   return color;
+}
+
+/**
+ * Computes the reflection/refraction child rays a hit spawns (after the
+ * Fresnel split and Russian roulette) along with the scalar weight each
+ * child's color contributes. Shared by the recursive path, which casts
+ * them on the spot, and the wavefront engine, which queues them for the
+ * next wave. Returns how many children were written (0-2).
+ */
+int RayTracer::makeSecondaryRays(const Intersection& intersection,
+ Ray children[2], double weights[2]) {
    double reflectivity = intersection.endMaterial->getReflectivity();
    double startRefractiveIndex = intersection.startMaterial->getRefractiveIndex();
    double endRefractiveIndex = intersection.endMaterial->getRefractiveIndex();
@@ -230,7 +1856,7 @@ Color RayTracer::getReflectiveRefractiveLighting(const Intersection& intersectio
     */
    if (reflectivity == NOT_REFLECTIVE && endRefractiveIndex == NOT_REFRACTIVE ||
     reflectionsRemaining <= 0) {
-      return Color();
+      return 0;
    }
 
    // Default to exclusively reflective values.
@@ -247,31 +1873,76 @@ Color RayTracer::getReflectiveRefractiveLighting(const Intersection& intersectio
 
    // No ref{ra,le}ctive properties - bail early.
    if (refractivePercentage <= 0 && reflectivePercentage <= 0) {
-      return Color();
+      return 0;
    }
 
-   Color reflectiveColor;
-   Color refractiveColor;
+   int count = 0;
 
    if (reflectivePercentage > 0) {
-      Vector reflected = reflectVector(intersection.ray.origin,
-       intersection.normal);
-      Ray reflectedRay(intersection.intersection, reflected, reflectionsRemaining - 1,
-       intersection.ray.material);
-
-      reflectiveColor = castRay(reflectedRay) * reflectivePercentage;
+      double throughput = intersection.ray.throughput * reflectivePercentage;
+      double scale = rouletteScale(intersection.ray, throughput);
+
+      if (scale > 0) {
+         Vector reflected = reflectVector(intersection.ray.origin,
+          intersection.normal);
+         Ray reflectedRay(intersection.intersection, reflected,
+          reflectionsRemaining - 1, intersection.ray.material);
+
+         reflectedRay.throughput = throughput;
+         reflectedRay.sampler = intersection.ray.sampler;
+
+         renderStats.local().reflectionRays++;
+         children[count] = reflectedRay;
+         weights[count] = reflectivePercentage * scale;
+         count++;
+      }
    }
 
    if (refractivePercentage > 0) {
-      Vector refracted = refractVector(intersection.normal,
-       intersection.ray.direction, startRefractiveIndex, endRefractiveIndex);
-      Ray refractedRay = Ray(intersection.intersection, refracted, 1,
-       intersection.endMaterial);
+      double throughput = intersection.ray.throughput * refractivePercentage;
+      double scale = rouletteScale(intersection.ray, throughput);
+
+      if (scale > 0) {
+         Vector refracted = refractVector(intersection.normal,
+          intersection.ray.direction, startRefractiveIndex, endRefractiveIndex);
+         Ray refractedRay = Ray(intersection.intersection, refracted, 1,
+          intersection.endMaterial);
+
+         refractedRay.throughput = throughput;
+         refractedRay.sampler = intersection.ray.sampler;
+
+         renderStats.local().refractionRays++;
+         children[count] = refractedRay;
+         weights[count] = refractivePercentage * scale;
+         count++;
+      }
+   }
+
+   return count;
+}
+
+/**
+ * Russian-roulette termination: rays whose accumulated throughput falls
+ * below rouletteThreshold survive with probability throughput/threshold
+ * and have their contribution boosted by the inverse, so the expected
+ * pixel value is unchanged while the deep tails of Glass/ShinyColor ray
+ * trees mostly die. Returns the scale to apply to the child's color, or
+ * 0 when the ray loses the gamble. Off by default (threshold 0).
+ */
+double RayTracer::rouletteScale(const Ray& ray, double& throughput) {
+   if (rouletteThreshold <= 0 || throughput >= rouletteThreshold ||
+    ray.sampler == NULL) {
+      return 1.0;
+   }
+
+   double survival = throughput / rouletteThreshold;
 
-      refractiveColor = castRay(refractedRay) * refractivePercentage;
+   if (ray.sampler->nextDouble() >= survival) {
+      return 0.0;
    }
 
-   return reflectiveColor + refractiveColor;
+   throughput = rouletteThreshold;
+   return 1.0 / survival;
 }
 
 double RayTracer::getReflectance(const Vector& normal, const Vector& incident,
@@ -285,32 +1956,142 @@ double RayTracer::getReflectance(const Vector& normal, const Vector& incident,
       return 1.0;
    }
 
-   double cosT = sqrt(1.0 - sinT2);
-   double r0rth = (n1 * cosI - n2 * cosT) / (n1 * cosI + n2 * cosT);
-   double rPar = (n2 * cosI - n1 * cosT) / (n2 * cosI + n1 * cosT);
-   return (r0rth * r0rth + rPar * rPar) / 2.0;
+   double cosT = sqrt(1.0 - sinT2);
+   double r0rth = (n1 * cosI - n2 * cosT) / (n1 * cosI + n2 * cosT);
+   double rPar = (n2 * cosI - n1 * cosT) / (n2 * cosI + n1 * cosT);
+   return (r0rth * r0rth + rPar * rPar) / 2.0;
+}
+
+Vector RayTracer::refractVector(const Vector& normal, const Vector& incident,
+ double n1, double n2) {
+   double n = n1 / n2;
+   double cosI = -normal.dot(incident);
+   double sinT2 = n * n * (1.0 - cosI * cosI);
+
+   if (sinT2 > 1.0) {
+      cerr << "Bad refraction vector!" << endl;
+      exit(EXIT_FAILURE);
+   }
+
+   double cosT = sqrt(1.0 - sinT2);
+   return incident * n + normal * (n * cosI - cosT);
+}
+
+Vector RayTracer::reflectVector(Vector vector, Vector normal) {
+   return normal * 2 * vector.dot(normal) - vector;
+}
+
+static bool compareLightIntensity(Light* a, Light* b) {
+   return a->intensity > b->intensity;
+}
+
+// The scene cache magic bakes in sizeof(Vector) so float- and
+// double-precision builds keep separate caches.
+// Bump the version whenever the cache layout changes so sidecars from
+// older builds get regenerated instead of misread.
+#define SCENE_CACHE_VERSION 5
+#define SCENE_CACHE_MAGIC (0x53435452 + (SCENE_CACHE_VERSION << 8) + \
+ (unsigned int)sizeof(Vector))
+
+/**
+ * Replays the characters the parser consumed since begin (a material
+ * definition, usually) and returns them as text, leaving the stream where
+ * it was. Empty on streams that can't seek (stdin).
+ */
+static string replayText(istream& in, streampos begin) {
+   if (begin < (streampos)0) {
+      return "";
+   }
+
+   if (in.eof()) {
+      // The definition ran to end of file; clear eof so we can seek.
+      in.clear();
+      in.seekg(0, ios_base::end);
+   }
+
+   streampos end = in.tellg();
+
+   if (end <= begin) {
+      return "";
+   }
+
+   string text((size_t)(end - begin), ' ');
+
+   in.seekg(begin);
+   in.read(&text[0], end - begin);
+
+   return text;
+}
+
+/**
+ * Interns the material text readMaterial just consumed in the capture's
+ * unique-definition table and returns its index, or -1 if the text could
+ * not be recovered (which disables caching for this parse).
+ */
+static int internMaterial(istream& in, streampos begin,
+ SceneCapture& capture, map<string, int>& index) {
+   string text = replayText(in, begin);
+
+   if (text.empty()) {
+      return -1;
+   }
+
+   map<string, int>::iterator itr = index.find(text);
+
+   if (itr != index.end()) {
+      return itr->second;
+   }
+
+   index[text] = (int)capture.materialDefs.size();
+   capture.materialDefs.push_back(text);
+
+   return (int)capture.materialDefs.size() - 1;
 }
 
-Vector RayTracer::refractVector(const Vector& normal, const Vector& incident,
- double n1, double n2) {
-   double n = n1 / n2;
-   double cosI = -normal.dot(incident);
-   double sinT2 = n * n * (1.0 - cosI * cosI);
+static void writeString(FILE* file, const string& text) {
+   unsigned int length = (unsigned int)text.size();
 
-   if (sinT2 > 1.0) {
-      cerr << "Bad refraction vector!" << endl;
+   fwrite(&length, sizeof(length), 1, file);
+   fwrite(text.data(), 1, length, file);
+}
+
+static void readExact(FILE* file, void* buffer, size_t size,
+ const string& cacheFile) {
+   if (size > 0 && fread(buffer, 1, size, file) != size) {
+      cerr << "Corrupt scene cache - delete " << cacheFile << endl;
       exit(EXIT_FAILURE);
    }
-
-   double cosT = sqrt(1.0 - sinT2);
-   return incident * n + normal * (n * cosI - cosT);
 }
 
-Vector RayTracer::reflectVector(Vector vector, Vector normal) {
-   return normal * 2 * vector.dot(normal) - vector;
+static string readString(FILE* file, const string& cacheFile) {
+   unsigned int length;
+
+   readExact(file, &length, sizeof(length), cacheFile);
+
+   string text(length, ' ');
+
+   if (length > 0) {
+      readExact(file, &text[0], length, cacheFile);
+   }
+
+   return text;
 }
 
-void RayTracer::readScene(istream& in) {
+void RayTracer::readScene(istream& in, string fileName) {
+   double parseStart = omp_get_wtime();
+
+   // Scenes loaded from a file keep a binary sidecar next to the text;
+   // when it's current the whole tokenizing pass is skipped.
+   if (!fileName.empty() && readSceneCache(fileName + "b", fileName)) {
+      finishScene(parseStart, fileName);
+      return;
+   }
+
+   bool caching = !fileName.empty();
+   SceneCapture capture;
+   map<string, int> internIndex;
+   vector<PendingModel> pendingModels;
+   vector<PendingModel> pendingInstances;
    string type;
 
    in >> type;
@@ -329,10 +2110,82 @@ void RayTracer::readScene(istream& in) {
          in >> size;
          in >> translate.x >> translate.y >> translate.z;
 
+         streampos materialStart = caching ? in.tellg() : (streampos)-1;
+         material = readMaterial(in);
+
+         if (caching) {
+            int index = internMaterial(in, materialStart, capture,
+             internIndex);
+
+            if (index < 0) {
+               caching = false;
+            } else {
+               capture.modelNames.push_back(model);
+               capture.modelSizes.push_back(size);
+               capture.modelTranslates.push_back(translate);
+               capture.modelMaterials.push_back(index);
+            }
+         }
+
+         // Deferred until the text parse finishes so every model file
+         // tokenizes in parallel instead of back to back.
+         PendingModel pendingModel;
+
+         pendingModel.model = model;
+         pendingModel.size = size;
+         pendingModel.translate = translate;
+         pendingModel.material = material;
+         pendingModels.push_back(pendingModel);
+      } else if (type.compare("instance") == 0) {
+         // Same fields as model, but placements of the same file share
+         // one copy of the geometry and one per-model BSP.
+         string model;
+         int size;
+         Vector translate;
+         Material* material;
+
+         in >> model;
+         in >> size;
+         in >> translate.x >> translate.y >> translate.z;
+
+         streampos materialStart = caching ? in.tellg() : (streampos)-1;
          material = readMaterial(in);
-         readModel(model, size, translate, material);
+
+         if (caching) {
+            int index = internMaterial(in, materialStart, capture,
+             internIndex);
+
+            if (index < 0) {
+               caching = false;
+            } else {
+               capture.instanceNames.push_back(model);
+               capture.instanceSizes.push_back(size);
+               capture.instanceTranslates.push_back(translate);
+               capture.instanceMaterials.push_back(index);
+            }
+         }
+
+         PendingModel pendingInstance;
+
+         pendingInstance.model = model;
+         pendingInstance.size = size;
+         pendingInstance.translate = translate;
+         pendingInstance.material = material;
+         pendingInstances.push_back(pendingInstance);
       } else if (type.compare("material") == 0) {
+         streampos defStart = caching ? in.tellg() : (streampos)-1;
+
          addMaterial(in);
+
+         if (caching) {
+            string text = replayText(in, defStart);
+
+            if (text.empty()) {
+               caching = false;
+            } else {
+               capture.namedDefs.push_back(text);
+            }
+         }
       } else if (type.compare("triangle") == 0) {
          Vector v0, v1, v2;
          Material* material;
@@ -340,9 +2193,29 @@ void RayTracer::readScene(istream& in) {
          in >> v0.x >> v0.y >> v0.z;
          in >> v1.x >> v1.y >> v1.z;
          in >> v2.x >> v2.y >> v2.z;
+
+         streampos materialStart = caching ? in.tellg() : (streampos)-1;
          material = readMaterial(in);
 
-         addObject(new Triangle(v0, v1, v2, material));
+         if (caching) {
+            int index = internMaterial(in, materialStart, capture,
+             internIndex);
+
+            if (index < 0) {
+               caching = false;
+            } else {
+               SceneTriangleRecord record;
+
+               record.v0 = v0;
+               record.v1 = v1;
+               record.v2 = v2;
+               record.material = index;
+               capture.triangles.push_back(record);
+            }
+         }
+
+         addObject(new (triangleArena.allocate()) Triangle(v0, v1, v2,
+          material));
       } else if (type.compare("sphere") == 0) {
          Vector center;
          double radius;
@@ -350,9 +2223,28 @@ void RayTracer::readScene(istream& in) {
 
          in >> center.x >> center.y >> center.z;
          in >> radius;
+
+         streampos materialStart = caching ? in.tellg() : (streampos)-1;
          material = readMaterial(in);
 
-         addObject(new Sphere(center, radius, material));
+         if (caching) {
+            int index = internMaterial(in, materialStart, capture,
+             internIndex);
+
+            if (index < 0) {
+               caching = false;
+            } else {
+               SceneSphereRecord record;
+
+               record.center = center;
+               record.radius = radius;
+               record.material = index;
+               capture.spheres.push_back(record);
+            }
+         }
+
+         addObject(new (sphereArena.allocate()) Sphere(center, radius,
+          material));
       } else if (type.compare("light") == 0) {
          Vector position;
          double intensity;
@@ -361,12 +2253,48 @@ void RayTracer::readScene(istream& in) {
          in >> intensity;
 
          addLight(new Light(position, intensity));
+      } else if (type.compare("areaLight") == 0) {
+         Vector position;
+         double intensity, radius;
+         int samples;
+
+         in >> position.x >> position.y >> position.z;
+         in >> intensity >> radius >> samples;
+
+         addLight(new Light(position, intensity, radius, samples));
       } else if (type.compare("dispersion") == 0) {
          in >> dispersion;
       } else if (type.compare("maxReflections") == 0) {
          in >> maxReflections;
+      } else if (type.compare("tileSize") == 0) {
+         in >> tileSize;
+      } else if (type.compare("adaptiveThreshold") == 0) {
+         in >> adaptiveThreshold;
+      } else if (type.compare("dofThreshold") == 0) {
+         in >> dofThreshold;
+      } else if (type.compare("lightCullThreshold") == 0) {
+         in >> lightCullThreshold;
+      } else if (type.compare("rouletteThreshold") == 0) {
+         in >> rouletteThreshold;
+      } else if (type.compare("costHeatmap") == 0) {
+         in >> costHeatmap;
+      } else if (type.compare("wavefront") == 0) {
+         in >> wavefront;
+      } else if (type.compare("sharedSamples") == 0) {
+         in >> sharedSamples;
       } else if (type.compare("startingMaterial") == 0) {
+         streampos materialStart = caching ? in.tellg() : (streampos)-1;
+
          startingMaterial = readMaterial(in);
+
+         if (caching) {
+            capture.startingMaterial = internMaterial(in, materialStart,
+             capture, internIndex);
+
+            if (capture.startingMaterial < 0) {
+               caching = false;
+            }
+         }
       } else if (type.compare("cameraUp") == 0) {
          in >> camera.up.x;
          in >> camera.up.y;
@@ -381,6 +2309,16 @@ void RayTracer::readScene(istream& in) {
          in >> camera.lookAt.z;
       } else if (type.compare("cameraScreenWidth") == 0) {
          in >> camera.screenWidth;
+      } else if (type.compare("cameraFrames") == 0) {
+         in >> cameraFrames;
+      } else if (type.compare("cameraKeyframe") == 0) {
+         Vector position, lookAt;
+
+         in >> position.x >> position.y >> position.z;
+         in >> lookAt.x >> lookAt.y >> lookAt.z;
+
+         cameraKeyframes.push_back(Camera(position, camera.up, lookAt,
+          camera.screenWidth));
       } else {
          cerr << "Type not found: " << type << endl;
          exit(EXIT_FAILURE);
@@ -389,79 +2327,602 @@ void RayTracer::readScene(istream& in) {
       in >> type;
    }
 
-   // Construct the top level BSP that contains all the objects..
-   bsp = new BSP(0, 'x', objects);
+   loadPendingModels(pendingModels);
+   loadPendingInstances(pendingInstances);
+
+   // Lights are still in file order here, which is what the cache stores.
+   if (caching) {
+      writeSceneCache(fileName + "b", capture);
+   }
+
+   finishScene(parseStart, fileName);
+}
+
+/**
+ * Post-parse work shared by the text and binary scene paths: optional
+ * light ordering, phase timing and the top-level BSP build.
+ */
+void RayTracer::finishScene(double parseStart, string fileName) {
+   // Brightest lights first, so with culling on the lights most likely to
+   // survive the threshold lead the shading loop. Accumulation order
+   // affects the result slightly (each light's intensity scales the
+   // running sum), so this only kicks in when culling is opted into.
+   if (lightCullThreshold > 0) {
+      sort(lights.begin(), lights.end(), compareLightIntensity);
+   }
+
+   // Model loads time themselves, so back their share out of the parse.
+   renderStats.parseSeconds =
+    omp_get_wtime() - parseStart - renderStats.modelSeconds;
+
+   // Construct the top level BSP that contains all the objects.. or warm
+   // start it from the <scene>.bvh sidecar. The sidecar carries a hash of
+   // every object's bounds, so it validates against the geometry actually
+   // loaded (scene edits, model edits, precision changes all miss) and
+   // parameter sweeps over the argv knobs skip the build entirely.
+   double buildStart = omp_get_wtime();
+   string bvhFile = fileName.empty() ? "" : fileName + ".bvh";
+   BSP* warm = NULL;
+
+   if (!bvhFile.empty()) {
+      FILE* in = fopen(bvhFile.c_str(), "rb");
+
+      if (in != NULL) {
+         warm = BSP::load(in, objects);
+         fclose(in);
+      }
+   }
+
+   if (warm != NULL) {
+      bsp = warm;
+      cout << "Loaded BVH cache: " << bvhFile << endl;
+   } else {
+      bsp = new BSP(objects);
+
+      if (!bvhFile.empty()) {
+         FILE* out = fopen(bvhFile.c_str(), "wb");
+
+         if (out != NULL) {
+            bsp->store(out, objects);
+            fclose(out);
+         }
+      }
+   }
+
+   renderStats.buildSeconds = omp_get_wtime() - buildStart;
+}
+
+/**
+ * Loads the binary scene sidecar if it is current: settings and camera
+ * come first, then material definitions (replayed through the normal
+ * material parser - there are only ever a handful), then the bulk entity
+ * records read straight into their structs. Returns false when the cache
+ * is missing or older than the scene text.
+ */
+bool RayTracer::readSceneCache(string cacheFile, string sceneFile) {
+   struct stat cacheStat, sceneStat;
+
+   if (stat(cacheFile.c_str(), &cacheStat) != 0 ||
+    stat(sceneFile.c_str(), &sceneStat) != 0 ||
+    cacheStat.st_mtime < sceneStat.st_mtime) {
+      return false;
+   }
+
+   FILE* file = fopen(cacheFile.c_str(), "rb");
+
+   if (file == NULL) {
+      return false;
+   }
+
+   unsigned int header[8];
+
+   if (fread(header, sizeof(header), 1, file) != 1 ||
+    header[0] != SCENE_CACHE_MAGIC) {
+      fclose(file);
+      return false;
+   }
+
+   int settingsInt[8];
+   double settingsDouble[6];
+   Vector cameraVectors[3];
+
+   readExact(file, settingsInt, sizeof(settingsInt), cacheFile);
+   readExact(file, settingsDouble, sizeof(settingsDouble), cacheFile);
+   readExact(file, cameraVectors, sizeof(cameraVectors), cacheFile);
+
+   maxReflections = settingsInt[0];
+   tileSize = settingsInt[1];
+   costHeatmap = settingsInt[2];
+   wavefront = settingsInt[3];
+   cameraFrames = settingsInt[4];
+   sharedSamples = settingsInt[7];
+   dispersion = settingsDouble[0];
+   adaptiveThreshold = settingsDouble[1];
+   lightCullThreshold = settingsDouble[2];
+   rouletteThreshold = settingsDouble[3];
+   camera.screenWidth = settingsDouble[4];
+   dofThreshold = settingsDouble[5];
+   camera.position = cameraVectors[0];
+   camera.up = cameraVectors[1];
+   camera.lookAt = cameraVectors[2];
+
+   for (int i = 0; i < settingsInt[5]; i++) {
+      Vector pair[2];
+
+      readExact(file, pair, sizeof(pair), cacheFile);
+      cameraKeyframes.push_back(Camera(pair[0], camera.up, pair[1],
+       camera.screenWidth));
+   }
+
+   for (unsigned int i = 0; i < header[1]; i++) {
+      istringstream defStream(readString(file, cacheFile));
+
+      addMaterial(defStream);
+   }
+
+   vector<Material*> table;
+
+   for (unsigned int i = 0; i < header[2]; i++) {
+      istringstream defStream(readString(file, cacheFile));
+
+      table.push_back(readMaterial(defStream));
+   }
+
+   if (settingsInt[6] >= 0 && settingsInt[6] < (int)table.size()) {
+      startingMaterial = table[settingsInt[6]];
+   }
+
+   for (unsigned int i = 0; i < header[3]; i++) {
+      SceneSphereRecord record;
+
+      readExact(file, &record, sizeof(record), cacheFile);
+      addObject(new (sphereArena.allocate()) Sphere(record.center,
+       record.radius, table[record.material]));
+   }
+
+   for (unsigned int i = 0; i < header[4]; i++) {
+      SceneTriangleRecord record;
+
+      readExact(file, &record, sizeof(record), cacheFile);
+      addObject(new (triangleArena.allocate()) Triangle(record.v0,
+       record.v1, record.v2, table[record.material]));
+   }
+
+   vector<PendingModel> pendingModels(header[5]);
+
+   for (unsigned int i = 0; i < header[5]; i++) {
+      string model = readString(file, cacheFile);
+      int size;
+      Vector translate;
+      int material;
+
+      readExact(file, &size, sizeof(size), cacheFile);
+      readExact(file, &translate, sizeof(translate), cacheFile);
+      readExact(file, &material, sizeof(material), cacheFile);
+
+      pendingModels[i].model = model;
+      pendingModels[i].size = size;
+      pendingModels[i].translate = translate;
+      pendingModels[i].material = table[material];
+   }
+
+   loadPendingModels(pendingModels);
+
+   vector<PendingModel> pendingInstances(header[7]);
+
+   for (unsigned int i = 0; i < header[7]; i++) {
+      string model = readString(file, cacheFile);
+      int size;
+      Vector translate;
+      int material;
+
+      readExact(file, &size, sizeof(size), cacheFile);
+      readExact(file, &translate, sizeof(translate), cacheFile);
+      readExact(file, &material, sizeof(material), cacheFile);
+
+      pendingInstances[i].model = model;
+      pendingInstances[i].size = size;
+      pendingInstances[i].translate = translate;
+      pendingInstances[i].material = table[material];
+   }
+
+   loadPendingInstances(pendingInstances);
+
+   for (unsigned int i = 0; i < header[6]; i++) {
+      Vector position;
+      double intensity, radius;
+      int samples;
+
+      readExact(file, &position, sizeof(position), cacheFile);
+      readExact(file, &intensity, sizeof(intensity), cacheFile);
+      readExact(file, &radius, sizeof(radius), cacheFile);
+      readExact(file, &samples, sizeof(samples), cacheFile);
+      addLight(new Light(position, intensity, radius, samples));
+   }
+
+   fclose(file);
+   cout << "Loaded scene cache: " << cacheFile << endl;
+
+   return true;
+}
+
+/**
+ * Writes the binary scene sidecar after a successful text parse. Failure
+ * is non-fatal - the next run just parses the text again.
+ */
+void RayTracer::writeSceneCache(string cacheFile,
+ const SceneCapture& capture) {
+   FILE* file = fopen(cacheFile.c_str(), "wb");
+
+   if (file == NULL) {
+      return;
+   }
+
+   unsigned int header[8] = { SCENE_CACHE_MAGIC,
+    (unsigned int)capture.namedDefs.size(),
+    (unsigned int)capture.materialDefs.size(),
+    (unsigned int)capture.spheres.size(),
+    (unsigned int)capture.triangles.size(),
+    (unsigned int)capture.modelNames.size(),
+    (unsigned int)lights.size(),
+    (unsigned int)capture.instanceNames.size() };
+   int settingsInt[8] = { maxReflections, tileSize, costHeatmap, wavefront,
+    cameraFrames, (int)cameraKeyframes.size(), capture.startingMaterial,
+    sharedSamples };
+   double settingsDouble[6] = { dispersion, adaptiveThreshold,
+    lightCullThreshold, rouletteThreshold, camera.screenWidth,
+    dofThreshold };
+   Vector cameraVectors[3] = { camera.position, camera.up, camera.lookAt };
+
+   fwrite(header, sizeof(header), 1, file);
+   fwrite(settingsInt, sizeof(settingsInt), 1, file);
+   fwrite(settingsDouble, sizeof(settingsDouble), 1, file);
+   fwrite(cameraVectors, sizeof(cameraVectors), 1, file);
+
+   for (size_t i = 0; i < cameraKeyframes.size(); i++) {
+      Vector pair[2] = { cameraKeyframes[i].position,
+       cameraKeyframes[i].lookAt };
+
+      fwrite(pair, sizeof(pair), 1, file);
+   }
+
+   for (size_t i = 0; i < capture.namedDefs.size(); i++) {
+      writeString(file, capture.namedDefs[i]);
+   }
+
+   for (size_t i = 0; i < capture.materialDefs.size(); i++) {
+      writeString(file, capture.materialDefs[i]);
+   }
+
+   if (!capture.spheres.empty()) {
+      fwrite(&capture.spheres[0], sizeof(SceneSphereRecord),
+       capture.spheres.size(), file);
+   }
+
+   if (!capture.triangles.empty()) {
+      fwrite(&capture.triangles[0], sizeof(SceneTriangleRecord),
+       capture.triangles.size(), file);
+   }
+
+   for (size_t i = 0; i < capture.modelNames.size(); i++) {
+      writeString(file, capture.modelNames[i]);
+      fwrite(&capture.modelSizes[i], sizeof(int), 1, file);
+      fwrite(&capture.modelTranslates[i], sizeof(Vector), 1, file);
+      fwrite(&capture.modelMaterials[i], sizeof(int), 1, file);
+   }
+
+   for (size_t i = 0; i < capture.instanceNames.size(); i++) {
+      writeString(file, capture.instanceNames[i]);
+      fwrite(&capture.instanceSizes[i], sizeof(int), 1, file);
+      fwrite(&capture.instanceTranslates[i], sizeof(Vector), 1, file);
+      fwrite(&capture.instanceMaterials[i], sizeof(int), 1, file);
+   }
+
+   for (size_t i = 0; i < lights.size(); i++) {
+      fwrite(&lights[i]->position, sizeof(Vector), 1, file);
+      fwrite(&lights[i]->intensity, sizeof(double), 1, file);
+      fwrite(&lights[i]->radius, sizeof(double), 1, file);
+      fwrite(&lights[i]->samples, sizeof(int), 1, file);
+   }
+
+   fclose(file);
 }
 
 void RayTracer::readModel(string model, int size, Vector translate, Material* material) {
-   string type;
-   vector<Vector> vertices;
-   Vector centerOffset;
-   double minX, maxX, minY, maxY, minZ, maxZ;
-   double offX = 0.0, offY = 0.0, offZ = 0.0, scale = 0.0;
+   vector<PendingModel> pending(1);
 
-   cout << model;
+   pending[0].model = model;
+   pending[0].size = size;
+   pending[0].translate = translate;
+   pending[0].material = material;
 
-   ifstream in;
-   in.open(model.c_str(), ifstream::in);
+   loadPendingModels(pending);
+}
 
-   if (in.fail()) {
-      cerr << "Failed opening model file" << endl;
-      exit(EXIT_FAILURE);
+/**
+ * Loads every collected model reference, overlapping the expensive parts
+ * (tokenizing, bounds and the baked transform) across threads. Turning
+ * the loaded data into Meshes and arena objects stays serial - the arena
+ * and shared vectors aren't thread-safe, and it's a memcpy-scale pass
+ * next to the tokenizing - and runs in capture order so the object list
+ * comes out deterministic.
+ */
+void RayTracer::loadPendingModels(vector<PendingModel>& pending) {
+   if (pending.empty()) {
+      return;
    }
 
-   in >> type;
-   while (in.good()) {
-      if (type.compare("Vertex") == 0) {
-         int index;
-         Vector v;
+   double modelStart = omp_get_wtime();
+
+   if (!quiet) {
+      for (size_t i = 0; i < pending.size(); i++) {
+         cout << pending[i].model;
+      }
+   }
+
+   #pragma omp parallel for schedule(dynamic)
+   for (int i = 0; i < (int)pending.size(); i++) {
+      loadModelData(pending[i]);
+   }
 
-         in >> index;
-         in >> v.x >> v.y >> v.z;
+   for (size_t i = 0; i < pending.size(); i++) {
+      finishModel(pending[i]);
+   }
+
+   renderStats.modelSeconds += omp_get_wtime() - modelStart;
+}
+
+void RayTracer::loadModelData(PendingModel& pending) {
+   string model = pending.model;
+   vector<Vector>& vertices = pending.vertices;
+   vector<int>& faces = pending.faces;
 
-         minX = min(minX, v.x);
-         minY = min(minY, v.y);
-         minZ = min(minZ, v.z);
+   // Untransformed vertices and face indices are cached in a binary
+   // sidecar file so repeated renders skip the token-by-token parse.
+   if (!readModelCache(model, vertices, faces)) {
+      string type;
+      ifstream in;
+      in.open(model.c_str(), ifstream::in);
 
-         maxX = max(maxX, v.x);
-         maxY = max(maxY, v.y);
-         maxZ = max(maxZ, v.z);
+      if (in.fail()) {
+         cerr << "Failed opening model file" << endl;
+         exit(EXIT_FAILURE);
+      }
+
+      in >> type;
+      while (in.good()) {
+         if (type.compare("Vertex") == 0) {
+            int index;
+            Vector v;
 
-         vertices.push_back(v);
-      } else if (type.compare("Face") == 0) {
-         // We are guaranteed to have all Vertices before Faces so we set this
-         // once for the first Face.
-         if (scale == 0.0) {
-            offX = (maxX + minX) / 2;
-            offY = (maxY + minY) / 2;
-            offZ = (maxZ + minZ) / 2;
-            centerOffset = Vector(offX, offY, offZ);
+            in >> index;
+            in >> v.x >> v.y >> v.z;
 
-            double distance = sqrt((maxX - minX) * (maxX - minX) +
-                                   (maxY - minY) * (maxY - minY) +
-                                   (maxZ - minZ) * (maxZ - minZ));
+            vertices.push_back(v);
+         } else if (type.compare("Face") == 0) {
+            int face, v0, v1, v2;
 
-            if (distance == 0.0)
-               exit(EXIT_FAILURE);
+            in >> face >> v0 >> v1 >> v2;
 
-            scale = size / distance;
+            faces.push_back(v0 - 1);
+            faces.push_back(v1 - 1);
+            faces.push_back(v2 - 1);
          }
 
-         int face, v0, v1, v2;
+         in >> type;
+      }
+
+      in.close();
+      writeModelCache(model, vertices, faces);
+   }
+
+   if (vertices.size() == 0) {
+      cerr << "Model has no vertices" << endl;
+      exit(EXIT_FAILURE);
+   }
+
+   Vector minV = vertices[0];
+   Vector maxV = vertices[0];
+
+   for (vector<Vector>::iterator itr = vertices.begin(); itr < vertices.end(); itr++) {
+      minV.x = min(minV.x, itr->x);
+      minV.y = min(minV.y, itr->y);
+      minV.z = min(minV.z, itr->z);
+
+      maxV.x = max(maxV.x, itr->x);
+      maxV.y = max(maxV.y, itr->y);
+      maxV.z = max(maxV.z, itr->z);
+   }
+
+   Vector centerOffset = (minV + maxV) * 0.5;
+   double distance = (maxV - minV).length();
+
+   if (distance == 0.0)
+      exit(EXIT_FAILURE);
+
+   double scale = pending.size / distance;
+
+   // Bake the center/scale/translate transform into the shared vertex
+   // buffer once instead of into three copied vertices per face.
+   for (vector<Vector>::iterator itr = vertices.begin(); itr < vertices.end(); itr++) {
+      *itr = (*itr - centerOffset) * scale + pending.translate;
+   }
+}
+
+void RayTracer::finishModel(PendingModel& pending) {
+   Mesh* mesh = new Mesh(pending.material);
+   vector<int>& faces = pending.faces;
+
+   mesh->vertices.swap(pending.vertices);
+
+   for (size_t i = 0; i < faces.size(); i += 3) {
+      addObject(new (meshTriangleArena.allocate()) MeshTriangle(mesh,
+       faces[i], faces[i + 1], faces[i + 2]));
+   }
+
+   meshes.push_back(mesh);
+}
 
-         in >> face >> v0 >> v1 >> v2;
+/**
+ * Builds one shared InstancedModel per distinct model file and then adds
+ * one lightweight Instance per placement. Prototype loads reuse the
+ * parallel model loader with a unit transform, so the object-space mesh
+ * comes out centered with a unit bounding diagonal and the instance's
+ * scale is just its size. Each prototype gets its own BSP here; the
+ * top-level tree built in finishScene only ever sees the placements.
+ */
+void RayTracer::loadPendingInstances(vector<PendingModel>& pending) {
+   if (pending.empty()) {
+      return;
+   }
 
-         Vector a = (vertices[v0 - 1] - centerOffset) * scale + translate;
-         Vector b = (vertices[v1 - 1] - centerOffset) * scale + translate;
-         Vector c = (vertices[v2 - 1] - centerOffset) * scale + translate;
+   double modelStart = omp_get_wtime();
+   vector<PendingModel> prototypes;
 
-         addObject(new Triangle(a, b, c, material));
+   for (size_t i = 0; i < pending.size(); i++) {
+      if (instancedModels.count(pending[i].model) > 0) {
+         continue;
       }
 
-      in >> type;
+      // Reserve the slot now so later placements of the same file don't
+      // queue a second prototype load.
+      instancedModels[pending[i].model] = NULL;
+
+      PendingModel prototype;
+
+      prototype.model = pending[i].model;
+      prototype.size = 1;
+      prototype.translate = Vector(0.0, 0.0, 0.0);
+      prototype.material = pending[i].material;
+      prototypes.push_back(prototype);
+
+      if (!quiet) {
+         cout << prototype.model;
+      }
+   }
+
+   #pragma omp parallel for schedule(dynamic)
+   for (int i = 0; i < (int)prototypes.size(); i++) {
+      loadModelData(prototypes[i]);
+   }
+
+   for (size_t i = 0; i < prototypes.size(); i++) {
+      InstancedModel* model = new InstancedModel();
+
+      model->mesh = new Mesh(prototypes[i].material);
+      model->mesh->vertices.swap(prototypes[i].vertices);
+
+      vector<int>& faces = prototypes[i].faces;
+
+      for (size_t face = 0; face < faces.size(); face += 3) {
+         model->faces.push_back(new (meshTriangleArena.allocate())
+          MeshTriangle(model->mesh, faces[face], faces[face + 1],
+          faces[face + 2]));
+      }
+
+      vector<Vector>& vertices = model->mesh->vertices;
+
+      model->bounds.min = vertices[0];
+      model->bounds.max = vertices[0];
+
+      for (size_t v = 1; v < vertices.size(); v++) {
+         model->bounds.min.x = min(model->bounds.min.x, vertices[v].x);
+         model->bounds.min.y = min(model->bounds.min.y, vertices[v].y);
+         model->bounds.min.z = min(model->bounds.min.z, vertices[v].z);
+
+         model->bounds.max.x = max(model->bounds.max.x, vertices[v].x);
+         model->bounds.max.y = max(model->bounds.max.y, vertices[v].y);
+         model->bounds.max.z = max(model->bounds.max.z, vertices[v].z);
+      }
+
+      model->tree = new BSP(model->faces);
+      meshes.push_back(model->mesh);
+      instancedModels[prototypes[i].model] = model;
+   }
+
+   for (size_t i = 0; i < pending.size(); i++) {
+      addObject(new Instance(instancedModels[pending[i].model],
+       (double)pending[i].size, pending[i].translate,
+       pending[i].material));
+   }
+
+   renderStats.modelSeconds += omp_get_wtime() - modelStart;
+}
+
+// "RTCM", with the vector size folded in so float and double precision
+// builds never read each other's caches.
+#define MODEL_CACHE_MAGIC (0x4d435452 + (unsigned int)sizeof(Vector))
+
+/**
+ * Loads vertices and face indices from the model's binary sidecar cache
+ * (<model>.bin) in two bulk reads. Returns false when the cache is
+ * missing, stale (older than the source model), or malformed.
+ */
+bool RayTracer::readModelCache(string model, vector<Vector>& vertices,
+ vector<int>& faces) {
+   string cacheFile = model + ".bin";
+   struct stat modelStat, cacheStat;
+
+   if (stat(model.c_str(), &modelStat) != 0 ||
+       stat(cacheFile.c_str(), &cacheStat) != 0 ||
+       cacheStat.st_mtime < modelStat.st_mtime) {
+      return false;
+   }
+
+   FILE* in = fopen(cacheFile.c_str(), "rb");
+
+   if (in == NULL) {
+      return false;
+   }
+
+   unsigned int header[3];
+
+   if (fread(header, sizeof(unsigned int), 3, in) != 3 ||
+       header[0] != MODEL_CACHE_MAGIC) {
+      fclose(in);
+      return false;
+   }
+
+   vertices.resize(header[1]);
+   faces.resize(header[2]);
+
+   bool ok =
+    fread(&vertices[0], sizeof(Vector), vertices.size(), in) == vertices.size() &&
+    fread(&faces[0], sizeof(int), faces.size(), in) == faces.size();
+
+   fclose(in);
+
+   if (!ok) {
+      vertices.clear();
+      faces.clear();
+   }
+
+   return ok;
+}
+
+/**
+ * Writes the binary sidecar cache next to the model. Failure to write
+ * (e.g. read-only model directory) is not fatal - the next run just
+ * parses the text again.
+ */
+void RayTracer::writeModelCache(string model, const vector<Vector>& vertices,
+ const vector<int>& faces) {
+   string cacheFile = model + ".bin";
+   FILE* out = fopen(cacheFile.c_str(), "wb");
+
+   if (out == NULL) {
+      return;
    }
 
-   in.close();
+   unsigned int header[3];
+   header[0] = MODEL_CACHE_MAGIC;
+   header[1] = vertices.size();
+   header[2] = faces.size();
+
+   fwrite(header, sizeof(unsigned int), 3, out);
+   fwrite(&vertices[0], sizeof(Vector), vertices.size(), out);
+   fwrite(&faces[0], sizeof(int), faces.size(), out);
+   fclose(out);
 }
 
 /**
@@ -474,20 +2935,51 @@ Material* RayTracer::readMaterial(istream& in) {
 
    if (type.compare("FlatColor") == 0) {
       material = new FlatColor(in);
+      materialBytes += sizeof(FlatColor);
    } else if (type.compare("ShinyColor") == 0) {
       material = new ShinyColor(in);
+      materialBytes += sizeof(ShinyColor);
    } else if (type.compare("Checkerboard") == 0) {
       material = new Checkerboard(in);
+      materialBytes += sizeof(Checkerboard);
    } else if (type.compare("Glass") == 0) {
       material = new Glass(in);
+      materialBytes += sizeof(Glass);
    } else if (type.compare("Turbulence") == 0) {
       material = new Turbulence(in);
+      materialBytes += sizeof(Turbulence);
    } else if (type.compare("Marble") == 0) {
       material = new Marble(in);
+      materialBytes += sizeof(Marble);
    } else if (type.compare("CrissCross") == 0) {
       material = new CrissCross(in);
+      materialBytes += sizeof(CrissCross);
    } else if (type.compare("Wood") == 0) {
       material = new Wood(in);
+      materialBytes += sizeof(Wood);
+   } else if (type.compare("Baked") == 0) {
+      int resolution;
+      Vector minBound, maxBound;
+
+      in >> resolution;
+      in >> minBound.x >> minBound.y >> minBound.z;
+      in >> maxBound.x >> maxBound.y >> maxBound.z;
+
+      if (resolution < 1) {
+         cerr << "Baked resolution must be at least 1" << endl;
+         exit(EXIT_FAILURE);
+      }
+
+      Material* source = readMaterial(in);
+      Baked* baked = new Baked(source, resolution, minBound, maxBound);
+
+      // The source parse consumed its own NormalMap token; the wrapper
+      // shares the map so bump mapping survives the bake. Return early
+      // like the named-material branch - there is no trailing token here.
+      baked->setNormalMap(source->getNormalMap());
+      materialBytes += sizeof(Baked) + baked->bytes();
+
+      return baked;
    } else if (materials.count(type) > 0) {
       material = materials[type];
 
@@ -511,6 +3003,7 @@ NormalMap* RayTracer::readNormalMap(istream& in) {
    if (type.compare("null") == 0) {
       return NULL;
    } else if (type.compare("NormalMap") == 0) {
+      materialBytes += sizeof(NormalMap);
       return new NormalMap(in);
    } else {
       cerr << "NormalMap not found: " << type << endl;
@@ -8,15 +8,79 @@
 #include <fstream>
 #include "Vector.h"
 #include "Camera.h"
+#include "Arena.h"
+#include "Sphere.h"
+#include "Triangle.h"
+#include "Mesh.h"
 
 class Ray;
 class Color;
+class Image;
 class Intersection;
 class Object;
 class Light;
 class Material;
 class NormalMap;
 class BSP;
+class Mesh;
+class Sampler;
+class InstancedModel;
+class ShadowBatch;
+
+// Fixed-size entity records in the binary scene cache (<scene>.scnb).
+class SceneSphereRecord {
+public:
+   Vector center;
+   double radius;
+   int material;
+};
+
+class SceneTriangleRecord {
+public:
+   Vector v0, v1, v2;
+   int material;
+};
+
+/**
+ * A model reference captured during parsing and loaded afterwards: model
+ * files tokenize in parallel once the scene text is done, so several
+ * large models overlap instead of loading back to back.
+ */
+class PendingModel {
+public:
+   std::string model;
+   int size;
+   Vector translate;
+   Material* material;
+   std::vector<Vector> vertices;
+   std::vector<int> faces;
+};
+
+/**
+ * Everything captured during a text scene parse that the binary cache
+ * needs to replay the scene without tokenizing: material definition texts
+ * (named ones in file order, inline ones deduplicated) and the bulk
+ * entity records. Settings and lights are written from the RayTracer
+ * members directly.
+ */
+class SceneCapture {
+public:
+   std::vector<std::string> namedDefs;
+   std::vector<std::string> materialDefs;
+   std::vector<SceneSphereRecord> spheres;
+   std::vector<SceneTriangleRecord> triangles;
+   std::vector<std::string> modelNames;
+   std::vector<int> modelSizes;
+   std::vector<Vector> modelTranslates;
+   std::vector<int> modelMaterials;
+   std::vector<std::string> instanceNames;
+   std::vector<int> instanceSizes;
+   std::vector<Vector> instanceTranslates;
+   std::vector<int> instanceMaterials;
+   int startingMaterial; // Index into materialDefs, -1 for the Air default.
+
+   SceneCapture() : startingMaterial(-1) {}
+};
 
 class RayTracer {
 public:
@@ -24,15 +88,34 @@ public:
    int height;
    int maxReflections;
    int superSamples; // Square root of number of samples to use for each pixel.
+   int tileSize; // Pixel dimension of the square tiles pulled by render threads.
    Camera camera;
    double imageScale;
    int depthComplexity;
    double dispersion;
-   unsigned long long raysCast;
+   double adaptiveThreshold; // Pixel variance below which supersampling stops early.
+   double dofThreshold; // Lens-sample variance below which the DoF loop stops early.
+   double lightCullThreshold; // Skip shadow rays for lights contributing less than this.
+   double rouletteThreshold; // Russian-roulette rays whose throughput falls below this.
+   double gamma; // Display gamma applied when quantizing output (--gamma).
+   int costHeatmap; // Write a false-color per-pixel cost TGA next to the render.
+   int wavefront; // Trace tiles with the wavefront engine instead of recursion.
+   int sharedSamples; // Integrate pixels over a shared per-tile sample lattice.
+   int resume; // Load finished tiles from the checkpoint sidecar and skip them.
+   int outOfCore; // Render band by band into a tile-high buffer (--out-of-core).
+   int cameraFrames; // Frames rendered along the camera keyframe path.
+   int progressive; // Refine one sample per pixel per pass, rewriting the output.
+   unsigned long long memoryBudget; // Byte cap for --memory-budget; 0 renders unchecked.
+   int quiet; // Suppress progress output entirely for farm logs (--quiet).
    Material* startingMaterial;
    BSP* bsp;
 
+   // Camera keyframes for batch animation: one scene load and BSP build
+   // serve every frame, with position/lookAt interpolated between these.
+   std::vector<Camera> cameraKeyframes;
+
    std::vector<Object*> objects;
+   std::vector<Mesh*> meshes;
    std::vector<Light*> lights;
    std::map<std::string, Material*> materials;
 
@@ -49,23 +132,84 @@ public:
    }
 
    void traceRays(std::string);
-   void readScene(std::istream&);
+   void serveTiles(int port, std::string fileName);
+   void workTiles(std::string host, int port);
+   void readScene(std::istream&, std::string fileName = "");
    void readModel(std::string, int size, Vector translate, Material* material);
 
 private:
-   Color castRayForPixel(int, int);
-   Color castRayAtPoint(const Vector&);
+   // Primitives live in typed arenas: contiguous slabs filled during
+   // parsing (via placement new) and freed en masse, so the geometry
+   // working set stays sequential instead of scattered across the heap.
+   Arena<Sphere> sphereArena;
+   Arena<Triangle> triangleArena;
+   Arena<MeshTriangle> meshTriangleArena;
+
+   // Shared models placed by the instance keyword, keyed by model file.
+   std::map<std::string, InstancedModel*> instancedModels;
+
+   // Last occluder seen per thread per light, tested before full traversal.
+   std::vector<std::vector<Object*> > occluderCache;
+
+   // Traversal cost per pixel, only filled when costHeatmap is set.
+   std::vector<double> pixelCost;
+
+   // The kernel instantiation rendering this frame's pixels.
+   Color (RayTracer::*pixelKernel)(int, int);
+
+   // Bytes allocated for materials and normal maps during parsing.
+   size_t materialBytes;
+
+   void traceFrame(std::string);
+   void traceBanded(std::string);
+   void traceProgressive(std::string);
+   void traceTile(int, int, Image&);
+   void traceTileWavefront(int, int, Image&);
+   void traceTileLattice(int, int, Image&);
+   bool readCheckpoint(int fd, std::vector<unsigned char>& tileDone, Image&);
+   void writeCheckpointTile(int fd, int tile, Image&);
+   void writeCostHeatmap(std::string);
+   // Pixel kernels are templated on the preset: SS is a compile-time
+   // supersample count (0 falls back to the runtime setting) and DOF
+   // mirrors depthComplexity > 1, so the common configurations run with
+   // constant trip counts and no per-pixel mode branches. selectPixelKernel
+   // picks the instantiation once per render.
+   template <int SS, bool DOF> Color castRayForPixelKernel(int, int);
+   template <bool DOF> Color castRayAtPointKernel(const Vector&, Sampler&);
+   template <bool DOF> Ray makeLensRay(const Vector& point, Sampler&,
+    int sampleIndex);
+   void selectPixelKernel();
+   void accountMemory();
+   void enforceMemoryBudget();
+   Color castProgressiveSample(int x, int y, int pass, int passes);
    Color castRay(const Ray&);
-   bool isInShadow(const Ray&, double);
+   void castRayPacket(const Ray rays[], int count, Color colors[]);
+   double getLightVisibility(const Intersection&, Light*, int lightIndex);
+   bool isInShadow(const Ray&, double, int lightIndex);
+   void flushShadowBatch(const Color&, ShadowBatch&, Color& diffuseColor,
+    Color& specularColor);
    Intersection getClosestIntersection(const Ray&);
    Color performLighting(const Intersection&);
    Color getAmbientLighting(const Intersection&, const Color&);
    Color getDiffuseAndSpecularLighting(const Intersection&, const Color&);
    Color getSpecularLighting(const Intersection&, Light*);
    Color getReflectiveRefractiveLighting(const Intersection&);
+   double rouletteScale(const Ray&, double& throughput);
+   int makeSecondaryRays(const Intersection&, Ray children[2],
+    double weights[2]);
    double getReflectance(const Vector&, const Vector&, double, double);
    Vector refractVector(const Vector&, const Vector&, double, double);
    Vector reflectVector(Vector, Vector);
+   void finishScene(double parseStart, std::string fileName);
+   bool readSceneCache(std::string cacheFile, std::string sceneFile);
+   void writeSceneCache(std::string cacheFile, const SceneCapture&);
+   void loadPendingModels(std::vector<PendingModel>&);
+   void loadPendingInstances(std::vector<PendingModel>&);
+   void loadModelData(PendingModel&);
+   void finishModel(PendingModel&);
+   bool readModelCache(std::string, std::vector<Vector>&, std::vector<int>&);
+   void writeModelCache(std::string, const std::vector<Vector>&,
+    const std::vector<int>&);
    Material* readMaterial(std::istream&);
    NormalMap* readNormalMap(std::istream&);
    void addMaterial(std::istream&);
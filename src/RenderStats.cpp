@@ -0,0 +1,57 @@
+#include "RenderStats.h"
+
+using namespace std;
+
+RenderStats renderStats;
+
+RenderStats::Counters RenderStats::total() const {
+   Counters sum;
+
+   for (vector<Counters>::const_iterator itr = counters.begin();
+    itr < counters.end(); itr++) {
+      sum.primaryRays += itr->primaryRays;
+      sum.shadowRays += itr->shadowRays;
+      sum.reflectionRays += itr->reflectionRays;
+      sum.refractionRays += itr->refractionRays;
+      sum.nodesVisited += itr->nodesVisited;
+      sum.objectTests += itr->objectTests;
+      sum.occluderCacheHits += itr->occluderCacheHits;
+   }
+
+   return sum;
+}
+
+unsigned long long RenderStats::totalRays() const {
+   Counters sum = total();
+
+   return sum.primaryRays + sum.shadowRays + sum.reflectionRays +
+    sum.refractionRays;
+}
+
+/**
+ * Machine-readable key=value report for the farm scheduler to ingest.
+ */
+void RenderStats::report(ostream& out) const {
+   Counters sum = total();
+
+   out << "stats.primaryRays=" << sum.primaryRays << endl;
+   out << "stats.shadowRays=" << sum.shadowRays << endl;
+   out << "stats.reflectionRays=" << sum.reflectionRays << endl;
+   out << "stats.refractionRays=" << sum.refractionRays << endl;
+   out << "stats.nodesVisited=" << sum.nodesVisited << endl;
+   out << "stats.objectTests=" << sum.objectTests << endl;
+   out << "stats.occluderCacheHits=" << sum.occluderCacheHits << endl;
+   out << "stats.bspLeaves=" << bspLeaves << endl;
+   out << "stats.bspMaxLeafSize=" << bspMaxLeafSize << endl;
+   out << "stats.bspOversizedLeaves=" << bspOversizedLeaves << endl;
+   out << "stats.bspMedianSplits=" << bspMedianSplits << endl;
+   out << "mem.geometry=" << geometryBytes << endl;
+   out << "mem.bsp=" << bspBytes << endl;
+   out << "mem.framebuffer=" << framebufferBytes << endl;
+   out << "mem.materials=" << materialBytes << endl;
+   out << "time.parse=" << parseSeconds << endl;
+   out << "time.models=" << modelSeconds << endl;
+   out << "time.bspBuild=" << buildSeconds << endl;
+   out << "time.render=" << renderSeconds << endl;
+   out << "time.imageWrite=" << writeSeconds << endl;
+}
@@ -0,0 +1,83 @@
+#ifndef __RENDER_STATS_H__
+#define __RENDER_STATS_H__
+
+#include <iostream>
+#include <vector>
+#include <omp.h>
+
+/**
+ * Per-thread render statistics. Every thread accumulates into its own
+ * cache-line-padded counter block (no data races, no line ping-pong on the
+ * hot path) and the blocks are merged once when the report is printed.
+ */
+class RenderStats {
+public:
+   class Counters {
+   public:
+      unsigned long long primaryRays;
+      unsigned long long shadowRays;
+      unsigned long long reflectionRays;
+      unsigned long long refractionRays;
+      unsigned long long nodesVisited;
+      unsigned long long objectTests;
+      unsigned long long occluderCacheHits;
+
+      // Pad the block past a cache line so neighboring threads' counters
+      // never share one.
+      char padding[64];
+
+      Counters() : primaryRays(0), shadowRays(0), reflectionRays(0),
+       refractionRays(0), nodesVisited(0), objectTests(0),
+       occluderCacheHits(0) {}
+   };
+
+   // Wall-clock phase totals in seconds, filled in by the driver code as
+   // each phase runs. writeSeconds accumulates the streamed band writes,
+   // which overlap the render.
+   double parseSeconds;
+   double modelSeconds;
+   double buildSeconds;
+   double renderSeconds;
+   double writeSeconds;
+
+   // Leaf-occupancy summary filled in once by the BSP build. Oversized
+   // means a leaf ended up holding more than MIN_OBJECT_COUNT objects
+   // because the SAH refused every split.
+   int bspLeaves;
+   int bspMaxLeafSize;
+   int bspOversizedLeaves;
+   int bspMedianSplits;
+
+   // Approximate resident bytes per subsystem, filled in once the scene
+   // is loaded (slab- and capacity-granular, not allocator-exact).
+   unsigned long long geometryBytes;
+   unsigned long long bspBytes;
+   unsigned long long framebufferBytes;
+   unsigned long long materialBytes;
+
+   RenderStats() : parseSeconds(0.0), modelSeconds(0.0), buildSeconds(0.0),
+    renderSeconds(0.0), writeSeconds(0.0), bspLeaves(0), bspMaxLeafSize(0),
+    bspOversizedLeaves(0), bspMedianSplits(0), geometryBytes(0),
+    bspBytes(0), framebufferBytes(0), materialBytes(0),
+    counters(omp_get_max_threads()) {}
+
+   /**
+    * The calling thread's counter block.
+    */
+   Counters& local() {
+      return counters[omp_get_thread_num()];
+   }
+
+   Counters total() const;
+   unsigned long long totalRays() const;
+   void report(std::ostream&) const;
+
+private:
+   std::vector<Counters> counters;
+};
+
+// Global instance so the hot paths in BSP and RayTracer can increment
+// without threading a pointer through every call.
+extern RenderStats renderStats;
+
+#endif
@@ -0,0 +1,100 @@
+#ifndef __SAMPLER_H__
+#define __SAMPLER_H__
+
+#include <math.h>
+
+/**
+ * Small deterministic random number generator (xorshift64*) owned by the
+ * ray casting call chain. Each pixel gets its own sampler seeded from its
+ * coordinates, so renders are reproducible across thread counts and there
+ * is no glibc rand() lock in the parallel loop.
+ */
+class Sampler {
+private:
+   unsigned long long state;
+
+public:
+   Sampler(unsigned long long seed) {
+      // Scramble the seed so consecutive pixel indices don't produce
+      // correlated first samples. Constants from splitmix64.
+      state = seed + 0x9e3779b97f4a7c15ULL;
+      state = (state ^ (state >> 30)) * 0xbf58476d1ce4e5b9ULL;
+      state = (state ^ (state >> 27)) * 0x94d049bb133111ebULL;
+      state = state ^ (state >> 31);
+
+      if (state == 0) {
+         state = 1;
+      }
+   }
+
+   /**
+    * Uniform double in [0, 1).
+    */
+   double nextDouble() {
+      state ^= state >> 12;
+      state ^= state << 25;
+      state ^= state >> 27;
+
+      return ((state * 0x2545f4914f6cdd1dULL) >> 11) *
+       (1.0 / 9007199254740992.0);
+   }
+
+   /**
+    * The index-th of count jittered low-discrepancy points on the unit
+    * square (Hammersley set: stratified in u, bit-reversed in v, both
+    * jittered within their stratum). Covers the square far more evenly
+    * than independent uniform draws, so lens sampling converges with a
+    * fraction of the samples.
+    */
+   void squareSample(int index, int count, double& u, double& v) {
+      u = (index + nextDouble()) / count;
+      v = radicalInverse((unsigned)index) + nextDouble() / count;
+
+      if (v >= 1.0) {
+         v -= 1.0;
+      }
+   }
+
+   /**
+    * Shirley-Chiu concentric mapping from the unit square to the unit
+    * disk. Preserves stratification and avoids the clumping a polar
+    * (sqrt, theta) mapping introduces near the center.
+    */
+   static void toDisk(double u, double v, double& dx, double& dy) {
+      double a = 2.0 * u - 1.0;
+      double b = 2.0 * v - 1.0;
+      double r, phi;
+
+      if (a == 0.0 && b == 0.0) {
+         dx = dy = 0.0;
+         return;
+      }
+
+      if (fabs(a) > fabs(b)) {
+         r = a;
+         phi = (M_PI / 4.0) * (b / a);
+      } else {
+         r = b;
+         phi = (M_PI / 2.0) - (M_PI / 4.0) * (a / b);
+      }
+
+      dx = r * cos(phi);
+      dy = r * sin(phi);
+   }
+
+private:
+   /**
+    * Base-2 radical inverse (van der Corput sequence).
+    */
+   static double radicalInverse(unsigned bits) {
+      bits = (bits << 16) | (bits >> 16);
+      bits = ((bits & 0x00ff00ffU) << 8) | ((bits & 0xff00ff00U) >> 8);
+      bits = ((bits & 0x0f0f0f0fU) << 4) | ((bits & 0xf0f0f0f0U) >> 4);
+      bits = ((bits & 0x33333333U) << 2) | ((bits & 0xccccccccU) >> 2);
+      bits = ((bits & 0x55555555U) << 1) | ((bits & 0xaaaaaaaaU) >> 1);
+
+      return bits * (1.0 / 4294967296.0);
+   }
+};
+
+#endif
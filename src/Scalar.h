@@ -0,0 +1,20 @@
+#ifndef __SCALAR_H__
+#define __SCALAR_H__
+
+/**
+ * Compile-time precision switch for the core math types. The default
+ * build keeps doubles for validation; building with -DRT_SINGLE_PRECISION
+ * (make PRECISION=-DRT_SINGLE_PRECISION) halves Vector/Color memory
+ * traffic and doubles the potential SIMD width, which is plenty of
+ * precision for 8-bit TGA output. Float vectors get padded out to a
+ * 16-byte alignment so vectorized loads stay aligned.
+ */
+#ifdef RT_SINGLE_PRECISION
+typedef float Scalar;
+#define RT_VECTOR_ALIGN __attribute__((aligned(16)))
+#else
+typedef double Scalar;
+#define RT_VECTOR_ALIGN
+#endif
+
+#endif
@@ -3,7 +3,7 @@
 #include "Vector.h"
 #include "Color.h"
 
-ShinyColor::ShinyColor(std::istream& in) {
+ShinyColor::ShinyColor(std::istream& in) : Material(MATERIAL_SHINY_COLOR) {
    in >> color.r >> color.g >> color.b;
    in >> shininess;
    in >> reflectivity;
@@ -12,11 +12,3 @@ ShinyColor::ShinyColor(std::istream& in) {
 Color ShinyColor::getColor(Vector point) {
    return color;
 }
-
-double ShinyColor::getShininess() {
-   return shininess;
-}
-
-double ShinyColor::getReflectivity() {
-   return reflectivity;
-}
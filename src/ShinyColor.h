@@ -6,14 +6,10 @@
 class ShinyColor : public Material {
 public:
    Color color;
-   double shininess;
-   double reflectivity;
 
    ShinyColor(std::istream&);
 
    virtual Color getColor(Vector);
-   virtual double getShininess();
-   virtual double getReflectivity();
 };
 
 #endif
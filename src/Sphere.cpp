@@ -2,7 +2,7 @@
 #include "Material.h"
 #include <math.h>
 
-Intersection Sphere::intersect(Ray ray) {
+bool Sphere::intersect(const Ray& ray, double tMax, Hit& hit) {
    Vector deltap = ray.origin - center;
    double a = ray.direction.dot(ray.direction);
    double b = deltap.dot(ray.direction) * 2;
@@ -10,7 +10,7 @@ Intersection Sphere::intersect(Ray ray) {
 
    double disc = b * b - 4 * a * c;
    if (disc < 0) {
-      return Intersection(); // No intersection.
+      return false; // No intersection.
    }
 
    disc = sqrt(disc);
@@ -36,11 +36,18 @@ Intersection Sphere::intersect(Ray ray) {
       distance = r2;
    }
 
-   if (distance < 0 || isnan(distance)) {
-      return Intersection(); // No intersection.
+   if (distance < 0 || distance >= tMax || isnan(distance)) {
+      return false; // No intersection.
    }
 
-   Vector point = ray.origin + (ray.direction * distance);
+   hit.distance = distance;
+   hit.object = this;
+
+   return true;
+}
+
+Intersection Sphere::getIntersection(const Ray& ray, const Hit& hit) {
+   Vector point = ray.origin + (ray.direction * hit.distance);
    Vector normal = (point - center).normalize();
 
    normal = material->modifyNormal(normal, point);
@@ -50,7 +57,45 @@ Intersection Sphere::intersect(Ray ray) {
       normal = normal * -1;
    }
 
-   return Intersection(ray, point, distance, normal, ray.material, material, this);
+   return Intersection(ray, point, hit.distance, normal, ray.material, material,
+    this);
+}
+
+bool Sphere::anyIntersection(const Ray& ray, double maxDistance) {
+   Vector deltap = ray.origin - center;
+   double a = ray.direction.dot(ray.direction);
+   double b = deltap.dot(ray.direction) * 2;
+   double c = deltap.dot(deltap) - (radius * radius);
+
+   double disc = b * b - 4 * a * c;
+   if (disc < 0) {
+      return false;
+   }
+
+   disc = sqrt(disc);
+
+   double q;
+   if (b < 0) {
+      q = (-b - disc) * 0.5;
+   } else {
+      q = (-b + disc) * 0.5;
+   }
+
+   double r1 = q / a;
+   double r2 = c / q;
+
+   if (r1 > r2) {
+      double tmp = r1;
+      r1 = r2;
+      r2 = tmp;
+   }
+
+   double distance = r1;
+   if (distance < 0) {
+      distance = r2;
+   }
+
+   return distance > 0 && distance < maxDistance && !isnan(distance);
 }
 
 Boundaries Sphere::getBounds() {
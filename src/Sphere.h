@@ -23,7 +23,9 @@ public:
       bounds.max = center + Vector(radius, radius, radius);
    }
 
-   virtual Intersection intersect(Ray);
+   virtual bool intersect(const Ray&, double tMax, Hit&);
+   virtual Intersection getIntersection(const Ray&, const Hit&);
+   virtual bool anyIntersection(const Ray&, double maxDistance);
    virtual Boundaries getBounds();
 
 private:
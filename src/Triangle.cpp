@@ -3,20 +3,15 @@
 #include "Triangle.h"
 #include "Material.h"
 
-Intersection Triangle::intersect(Ray ray) {
-  Vector e1, e2, h, s, q, normal;
+bool Triangle::intersect(const Ray& ray, double tMax, Hit& hit) {
+  Vector h, s, q;
   double a, f, u, v, distance;
 
-  e1 = Vector(v1.x - v0.x, v1.y - v0.y, v1.z - v0.z);
-  e2 = Vector(v2.x - v0.x, v2.y - v0.y, v2.z - v0.z);
-
-  normal = ((v1 - v0).cross(v2 - v0)).normalize();
-
   h = ray.direction.cross(e2);
   a = e1.dot(h);
 
   if (a > -0.00001 && a < 0.00001)
-     return Intersection();
+     return false;
 
   f = 1 / a;
   s = Vector(ray.origin.x - v0.x,
@@ -25,23 +20,62 @@ Intersection Triangle::intersect(Ray ray) {
   u = f * s.dot(h);
 
   if (u < 0.0 || u > 1.0)
-     return Intersection();
+     return false;
 
   q = s.cross(e1);
   v = f * ray.direction.dot(q);
 
   if (v < 0.0 || u + v > 1.0)
-     return Intersection();
+     return false;
 
   distance = f * e2.dot(q);
 
   // Ray Intersection
-  if (distance > 0.00001) {
-     Vector point = ray.origin + Vector(distance) * ray.direction;
-     return Intersection(ray, point, distance, normal, ray.material, material, this);
+  if (distance > 0.00001 && distance < tMax) {
+     hit.distance = distance;
+     hit.object = this;
+
+     return true;
   }
 
-  return Intersection();
+  return false;
+}
+
+Intersection Triangle::getIntersection(const Ray& ray, const Hit& hit) {
+   Vector point = ray.origin + Vector(hit.distance) * ray.direction;
+
+   return Intersection(ray, point, hit.distance, normal, ray.material, material,
+    this);
+}
+
+bool Triangle::anyIntersection(const Ray& ray, double maxDistance) {
+  Vector h, s, q;
+  double a, f, u, v, distance;
+
+  h = ray.direction.cross(e2);
+  a = e1.dot(h);
+
+  if (a > -0.00001 && a < 0.00001)
+     return false;
+
+  f = 1 / a;
+  s = Vector(ray.origin.x - v0.x,
+   ray.origin.y - v0.y, ray.origin.z - v0.z);
+
+  u = f * s.dot(h);
+
+  if (u < 0.0 || u > 1.0)
+     return false;
+
+  q = s.cross(e1);
+  v = f * ray.direction.dot(q);
+
+  if (v < 0.0 || u + v > 1.0)
+     return false;
+
+  distance = f * e2.dot(q);
+
+  return distance > 0.00001 && distance < maxDistance;
 }
 
 Boundaries Triangle::getBounds() {
@@ -14,11 +14,29 @@ class Material;
 class Triangle : public Object {
 public:
    Vector v0, v1, v2;
+   // Hoisted out of the intersection kernel - these never change after
+   // construction.
+   Vector e1, e2;
+   Vector normal;
    Material* material;
    Boundaries bounds;
 
    Triangle(Vector v0_, Vector v1_, Vector v2_, Material* material_) :
     v0(v0_), v1(v1_), v2(v2_), material(material_) {
+      e1 = v1 - v0;
+      e2 = v2 - v0;
+
+      Vector area = e1.cross(e2);
+
+      // Degenerate (zero-area) triangles can never pass the intersection
+      // test, but normalizing their zero cross product would seed NaNs
+      // into the lighting math, so give them an arbitrary finite normal.
+      if (area.dot(area) == 0.0) {
+         area = Vector(0.0, 0.0, 1.0);
+      }
+
+      normal = area.normalize();
+
       bounds.min = Vector(std::min(v0.x, std::min(v1.x, v2.x)),
                           std::min(v0.y, std::min(v1.y, v2.y)),
                           std::min(v0.z, std::min(v1.z, v2.z)));
@@ -28,7 +46,9 @@ public:
                           std::max(v0.z, std::max(v1.z, v2.z)));
    }
 
-   virtual Intersection intersect(Ray);
+   virtual bool intersect(const Ray&, double tMax, Hit&);
+   virtual Intersection getIntersection(const Ray&, const Hit&);
+   virtual bool anyIntersection(const Ray&, double maxDistance);
    virtual Boundaries getBounds();
 
 private:
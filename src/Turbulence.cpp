@@ -3,7 +3,7 @@
 #include "Vector.h"
 #include "Color.h"
 
-Turbulence::Turbulence(std::istream& in) {
+Turbulence::Turbulence(std::istream& in) : Material(MATERIAL_TURBULENCE) {
    in >> color1.r >> color1.g >> color1.b;
    in >> color2.r >> color2.g >> color2.b;
    in >> scale;
@@ -16,22 +16,25 @@ Color Turbulence::getColor(Vector point) {
    double y = point.y * scale;
    double z = point.z * scale;
    double noiseCoef = 0;
+   double nx[4], ny[4], nz[4], n[4];
 
-   for (int level = 1; level < 10; level ++) {
-      noiseCoef += (1.0f / level) * fabsf(perlin.noise(
-         level * 0.05 * x,
-         level * 0.05 * y,
-         level * 0.05 * z
-      ));
-   }
+   // Octaves run four at a time through the batched noise kernel; the
+   // accumulation order matches the old scalar loop exactly.
+   for (int level = 1; level < 10; level += 4) {
+      int batch = 10 - level < 4 ? 10 - level : 4;
 
-   return color1 * noiseCoef + color2 * (1.0f - noiseCoef);
-}
+      for (int i = 0; i < batch; i++) {
+         nx[i] = (level + i) * 0.05 * x;
+         ny[i] = (level + i) * 0.05 * y;
+         nz[i] = (level + i) * 0.05 * z;
+      }
 
-double Turbulence::getShininess() {
-   return shininess;
-}
+      perlin.noise4(nx, ny, nz, n, batch);
 
-double Turbulence::getReflectivity() {
-   return reflectivity;
+      for (int i = 0; i < batch; i++) {
+         noiseCoef += (1.0f / (level + i)) * fabsf(n[i]);
+      }
+   }
+
+   return color1 * noiseCoef + color2 * (1.0f - noiseCoef);
 }
@@ -1,6 +1,10 @@
 #include <math.h>
 #include "Vector.h"
 
+// SIMD builds (-DRT_SIMD) define every operation inline in Vector.h on
+// the four-lane vector type; these scalar bodies are the default build.
+#ifndef RT_SIMD
+
 Vector Vector::normalize() {
    return (*this) /= this->length();
 }
@@ -9,11 +13,11 @@ Vector Vector::cross(Vector const & v) const {
    return Vector(y*v.z - v.y*z, v.x*z - x*v.z, x*v.y - v.x*y);
 }
 
-double Vector::dot(Vector const & v) const {
+Scalar Vector::dot(Vector const & v) const {
    return x*v.x + y*v.y + z*v.z;
 }
 
-double Vector::length() const {
+Scalar Vector::length() const {
    return sqrtf(x*x + y*y + z*z);
 }
 
@@ -65,11 +69,11 @@ Vector & Vector::operator /= (Vector const & v) {
    return * this;
 }
 
-Vector Vector::operator * (double const s) const {
+Vector Vector::operator * (Scalar const s) const {
    return Vector(x*s, y*s, z*s);
 }
 
-Vector & Vector::operator *= (double const s) {
+Vector & Vector::operator *= (Scalar const s) {
    x *= s;
    y *= s;
    z *= s;
@@ -77,14 +81,16 @@ Vector & Vector::operator *= (double const s) {
    return * this;
 }
 
-Vector Vector::operator / (double const s) const {
+Vector Vector::operator / (Scalar const s) const {
    return Vector(x/s, y/s, z/s);
 }
 
-Vector & Vector::operator /= (double const s) {
+Vector & Vector::operator /= (Scalar const s) {
    x /= s;
    y /= s;
    z /= s;
 
    return * this;
 }
+
+#endif
@@ -1,24 +1,142 @@
 #ifndef __VECTOR_H__
 #define __VECTOR_H__
 
-class Vector {
+#include <math.h>
+#include "Scalar.h"
+
+#ifdef RT_SIMD
+// Four Scalar lanes backing Vector in SIMD builds (make SIMD=-DRT_SIMD).
+// GCC's portable vector extensions compile the elementwise operators to
+// single SSE/AVX instructions; the fourth lane is padding that keeps the
+// loads aligned and is never read.
+typedef Scalar VectorLanes __attribute__((vector_size(4 * sizeof(Scalar))));
+#endif
+
+class RT_VECTOR_ALIGN Vector {
 public:
 
-   double x, y, z;
+#ifdef RT_SIMD
+   // The anonymous union keeps the x/y/z member access every call site
+   // uses while the operators work on all four lanes at once.
+   union {
+      struct { Scalar x, y, z, w; };
+      VectorLanes lanes;
+   };
+
+   Vector() {
+      x = y = z = w = 0;
+   }
+
+   Vector(Scalar in) {
+      x = y = z = in;
+      w = 0;
+   }
+
+   Vector(Scalar in_x, Scalar in_y, Scalar in_z) {
+      x = in_x;
+      y = in_y;
+      z = in_z;
+      w = 0;
+   }
+
+   Vector normalize() {
+      return (*this) /= this->length();
+   }
+
+   Vector cross(Vector const & v) const {
+      return Vector(y*v.z - v.y*z, v.x*z - x*v.z, x*v.y - v.x*y);
+   }
+
+   Scalar dot(Vector const & v) const {
+      VectorLanes products = lanes * v.lanes;
+
+      return products[0] + products[1] + products[2];
+   }
+
+   Scalar length() const {
+      return sqrtf(this->dot(*this));
+   }
+
+   Vector operator + (Vector const & v) const {
+      return Vector(lanes + v.lanes);
+   }
+
+   Vector & operator += (Vector const & v) {
+      lanes += v.lanes;
+
+      return * this;
+   }
+
+   Vector operator - (Vector const & v) const {
+      return Vector(lanes - v.lanes);
+   }
+
+   Vector & operator -= (Vector const & v) {
+      lanes -= v.lanes;
+
+      return * this;
+   }
+
+   Vector operator * (Vector const & v) const {
+      return Vector(lanes * v.lanes);
+   }
+
+   Vector & operator *= (Vector const & v) {
+      lanes *= v.lanes;
+
+      return * this;
+   }
+
+   // The pad lanes divide too (0/0 makes a quiet NaN there), but the
+   // fourth lane is never read so it can't leak into results.
+   Vector operator / (Vector const & v) const {
+      return Vector(lanes / v.lanes);
+   }
+
+   Vector & operator /= (Vector const & v) {
+      lanes /= v.lanes;
+
+      return * this;
+   }
+
+   Vector operator * (Scalar const s) const {
+      return Vector(lanes * s);
+   }
+
+   Vector & operator *= (Scalar const s) {
+      lanes *= s;
+
+      return * this;
+   }
+
+   Vector operator / (Scalar const s) const {
+      return Vector(lanes / s);
+   }
+
+   Vector & operator /= (Scalar const s) {
+      lanes /= s;
+
+      return * this;
+   }
+
+private:
+   Vector(VectorLanes in) : lanes(in) {}
+#else
+   Scalar x, y, z;
 
    Vector() : x(0), y(0), z(0) {}
 
-   Vector(double in) : x(in), y(in), z(in) {}
+   Vector(Scalar in) : x(in), y(in), z(in) {}
 
-   Vector(double in_x, double in_y, double in_z) : x(in_x), y(in_y), z(in_z) {}
+   Vector(Scalar in_x, Scalar in_y, Scalar in_z) : x(in_x), y(in_y), z(in_z) {}
 
    Vector normalize();
 
    Vector cross(Vector const & v) const;
 
-   double dot(Vector const & v) const;
+   Scalar dot(Vector const & v) const;
 
-   double length() const;
+   Scalar length() const;
 
    Vector operator + (Vector const & v) const;
 
@@ -36,13 +154,14 @@ public:
 
    Vector & operator /= (Vector const & v);
 
-   Vector operator * (double const s) const;
+   Vector operator * (Scalar const s) const;
 
-   Vector & operator *= (double const s);
+   Vector & operator *= (Scalar const s);
 
-   Vector operator / (double const s) const;
+   Vector operator / (Scalar const s) const;
 
-   Vector & operator /= (double const s);
+   Vector & operator /= (Scalar const s);
+#endif
 };
 
 #endif
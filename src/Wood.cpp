@@ -3,7 +3,7 @@
 #include "Vector.h"
 #include "Color.h"
 
-Wood::Wood(std::istream& in) {
+Wood::Wood(std::istream& in) : Material(MATERIAL_WOOD) {
    in >> color1.r >> color1.g >> color1.b;
    in >> color2.r >> color2.g >> color2.b;
    in >> scale;
@@ -22,11 +22,3 @@ Color Wood::getColor(Vector point) {
 
    return color1 * grain + color2 * (1.0f - grain);
 }
-
-double Wood::getShininess() {
-   return shininess;
-}
-
-double Wood::getReflectivity() {
-   return reflectivity;
-}
@@ -10,15 +10,11 @@ private:
    Color color1;
    Color color2;
    double scale;
-   double shininess;
-   double reflectivity;
 
 public:
    Wood(std::istream&);
 
    virtual Color getColor(Vector);
-   virtual double getShininess();
-   virtual double getReflectivity();
 };
 
 #endif
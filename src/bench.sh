@@ -0,0 +1,40 @@
+#!/bin/bash
+
+# Renders a fixed scene suite several times each and reports min/median
+# render times plus rays per second as CSV, for regression tracking across
+# commits. Usage: ./bench.sh [repeats] [outCsv]
+
+make
+
+REPEATS=${1:-3}
+OUT_CSV=${2:-bench.csv}
+SUPER_SAMPLES=1
+DEPTH_COMPLEXITY=1
+SCENES="bunny.scn dragon.scn ballsInAPit.scn tumbledStones.scn"
+
+echo "scene,superSamples,depthComplexity,repeats,minRenderSeconds,medianRenderSeconds,raysPerSecond" > $OUT_CSV
+
+cd ../scenes
+for scene in $SCENES
+do
+   times=""
+   rays=0
+   for i in `seq 1 $REPEATS`
+   do
+      log=`../src/RayTracer $scene $SUPER_SAMPLES $DEPTH_COMPLEXITY /tmp/bench_$$.tga 2>/dev/null`
+      t=`echo "$log" | sed -n 's/^time\.render=//p'`
+      rays=`echo "$log" | grep -o 'Rays cast: [0-9]*' | sed 's/Rays cast: //'`
+      times="$times$t
+"
+   done
+
+   min=`echo "$times" | grep . | sort -g | head -1`
+   median=`echo "$times" | sort -g | awk -v n=$REPEATS 'NF { v[++i] = $1 } END { print v[int((i + 1) / 2)] }'`
+   raysPerSec=`echo "$rays $min" | awk '{ printf "%d", $1 / $2 }'`
+
+   echo "$scene,$SUPER_SAMPLES,$DEPTH_COMPLEXITY,$REPEATS,$min,$median,$raysPerSec" >> ../src/$OUT_CSV
+   echo "$scene: min ${min}s median ${median}s $raysPerSec rays/s"
+done
+
+rm -f /tmp/bench_$$.tga
+echo "Wrote ../src/$OUT_CSV"
@@ -2,7 +2,6 @@
 #include <string.h>
 #include <iostream>
 #include <fstream>
-#include <ctime>
 #include "RayTracer.h"
 
 using namespace std;
@@ -13,11 +12,12 @@ using namespace std;
 int main(int argc, char** argv) {
    if (argc < 4) {
       cerr << "Usage: " << argv[0] << " sceneFile superSamples " <<
-       "depthComplexity [outFile]" << endl;
+       "depthComplexity [outFile] [--resume] [--progressive] " <<
+       "[--out-of-core] [--quiet] [--gamma g] [--memory-budget mb] " <<
+       "[--serve port | --worker host:port]" << endl;
       exit(EXIT_FAILURE);
    }
 
-   srand((unsigned)time(0));
    int maxReflections = 10;
    int superSamples = atoi(argv[2]);
    int depthComplexity = atoi(argv[3]);
@@ -35,20 +35,58 @@ int main(int argc, char** argv) {
          exit(EXIT_FAILURE);
       }
 
-      rayTracer.readScene(inFileStream);
+      rayTracer.readScene(inFileStream, inFile);
       inFileStream.close();
    }
 
    string outFile;
+   int servePort = 0;
+   string workerHost;
+   int workerPort = 0;
 
-   if (argc > 4) {
-      outFile = argv[4];
-   } else {
+   for (int i = 4; i < argc; i++) {
+      if (strcmp(argv[i], "--resume") == 0) {
+         rayTracer.resume = 1;
+      } else if (strcmp(argv[i], "--progressive") == 0) {
+         rayTracer.progressive = 1;
+      } else if (strcmp(argv[i], "--out-of-core") == 0) {
+         rayTracer.outOfCore = 1;
+      } else if (strcmp(argv[i], "--quiet") == 0) {
+         rayTracer.quiet = 1;
+      } else if (strcmp(argv[i], "--gamma") == 0 && i + 1 < argc) {
+         rayTracer.gamma = atof(argv[++i]);
+      } else if (strcmp(argv[i], "--memory-budget") == 0 && i + 1 < argc) {
+         rayTracer.memoryBudget =
+          (unsigned long long)(atof(argv[++i]) * 1024 * 1024);
+      } else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc) {
+         servePort = atoi(argv[++i]);
+      } else if (strcmp(argv[i], "--worker") == 0 && i + 1 < argc) {
+         char* colon = strchr(argv[++i], ':');
+
+         if (colon == NULL) {
+            cerr << "--worker needs host:port" << endl;
+            exit(EXIT_FAILURE);
+         }
+
+         workerHost = string(argv[i], colon - argv[i]);
+         workerPort = atoi(colon + 1);
+      } else {
+         outFile = argv[i];
+      }
+   }
+
+   if (outFile.empty() && workerHost.empty()) {
       cerr << "No outFile specified - writing to out.tga" << endl;
       outFile = "out.tga";
    }
 
-   rayTracer.traceRays(outFile);
+   if (servePort > 0) {
+      rayTracer.serveTiles(servePort, outFile);
+   } else if (!workerHost.empty()) {
+      rayTracer.workTiles(workerHost, workerPort);
+   } else {
+      rayTracer.traceRays(outFile);
+   }
 
    exit(EXIT_SUCCESS);
 }